@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdio.h>
+#include "../Lab6/gpio_out.h"
 
 /*
  * On board LED blink C example
@@ -65,8 +66,11 @@ int main()
 		return MRAA_ERROR_UNSPECIFIED;
 	}
 
-	// set the pin as output
-	if (mraa_gpio_dir(d_pin, MRAA_GPIO_OUT) != MRAA_SUCCESS) {
+	// set the pin as output, written only when its value changes
+	struct gpio_out led;
+	gpio_out_init(&led);
+	int on_board = gpio_out_add(&led, d_pin);
+	if (on_board < 0) {
 		fprintf(stderr, "Can't set digital pin as output, exiting");
 		return MRAA_ERROR_UNSPECIFIED;
 	};
@@ -75,9 +79,9 @@ int main()
 
 	// loop forever toggling the on board LED every second
 	for (;;) {
-		mraa_gpio_write(d_pin, 0);
+		gpio_out_write(&led, on_board, 0);
 		sleep(1);
-		mraa_gpio_write(d_pin, 1);
+		gpio_out_write(&led, on_board, 1);
 		sleep(1);
 	}
 
@@ -1,13 +1,18 @@
 #include "mraa.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include "adc_sampler.h"
+#include "adc_lut.h"
 
 /*
  * CS 490 Lab-2 Part-2
  *
  * Reads in the values from the x-axis on the accelerometer and
  * prints them out as a hexadecimal, an integer value, and a
- * floating point value normalized to +- 1g.
+ * floating point value normalized to +- 1g. The axis is sampled
+ * in the background at SAMPLE_RATE and each printed value is the
+ * average of the samples taken since the last print.
  *
  * @author Cameron Stanavige & Gene Osborne
  * @version 10/9/2015
@@ -23,42 +28,42 @@ const float xZeroG = 1449;
 const float xPosG = 1722;
 const float xNegG = 1171;
 
-// function prototypes
-float normalize(unsigned int, float, float, float);
+// samples per second taken from the x-axis
+#define SAMPLE_RATE 1000
 
 int main(int argc, char* argv[]) {
 	// variable declarations
 	unsigned int xValue;
+	unsigned long sum;
+	int n, i;
+	static struct adc_sampler sampler;
+	static struct adc_frame frames[ADC_RING_FRAMES];
+	static struct adc_lut xLut;
+	const unsigned int xPin = 0;
 
-	// set the pin to be used
-	mraa_aio_context xAxis = mraa_aio_init(0);
-	// change the bit accuracy to 12 bits
-	mraa_aio_set_bit(xAxis, 12);
-
-	if (xAxis == NULL) {
+	// sample the x-axis at 12 bits
+	if (adc_sampler_init(&sampler, &xPin, 1, SAMPLE_RATE, 12) < 0
+			|| adc_sampler_start(&sampler) < 0) {
 		fprintf(stderr, "Coulnd't initialize AIO, exiting");
 		return MRAA_ERROR_UNSPECIFIED;
 	}
 
+	// readings to g for every possible count
+	if (adc_lut_init(&xLut, 12, xZeroG, xPosG, xNegG) < 0) {
+		fprintf(stderr, "Couldn't build the conversion table, exiting");
+		return MRAA_ERROR_UNSPECIFIED;
+	}
+
 	// loop to run program
 	for (;;) {
-		xValue = mraa_aio_read(xAxis);
-		printf("xAxis: %x, %d, %f\n", xValue, xValue, normalize(xValue, xZeroG, xPosG, xNegG));
 		usleep(200000);
+		n = adc_sampler_read(&sampler, frames, ADC_RING_FRAMES);
+		if (n == 0)
+			continue;
+		for (sum = 0, i = 0; i < n; i++)
+			sum += frames[i].value[0];
+		xValue = (sum + n / 2) / n;
+		printf("xAxis: %x, %d, %f\n", xValue, xValue, xLut.g[xValue]);
 	}
-	mraa_aio_close(xAxis);
+	adc_sampler_close(&sampler);
 } // end main
-
-/**
- * Function to normalize the value being read in to +- 1g.
- *
- * @param reading The value that was read in from the accelerometer
- * @param middle The value to determine what is zero
- * @param max The value to determine what is 1g
- * @param min The value to determine what is -1g
- *
- * @return Floating point value normalized between -1 and 1
- */
-float normalize(unsigned int reading, float middle, float max, float min) {
-	return reading > middle ? (reading - middle) / (max - middle) : (reading - middle) / (middle - min);
-} // end normlize
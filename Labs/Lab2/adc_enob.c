@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "adc_oversample.h"
+
+/*
+ * Reports the noise floor and effective number of bits of the
+ * accelerometer inputs (x on A0, y on A1) for every oversampling
+ * setting, with and without dither, so the trade between output rate
+ * and resolution can be chosen for the level. Keep the accelerometer
+ * still while it runs.
+ *
+ * Usage: adc_enob [output rate in Hz] [dither PWM pin]
+ *
+ * @author Cameron Stanavige & Gene Osborne
+ * @version 10/19/2026
+ */
+
+// output frames measured for each setting
+#define MEASURE_FRAMES 100
+// output frames thrown away first while the filters fill
+#define SETTLE_FRAMES 4
+
+/*
+ * Measure one setting and print a line per axis.
+ *
+ * @param rate Output frames per second
+ * @param extra Extra bits of oversampling
+ * @param dither PWM pin for dither, or ADC_NO_DITHER
+ *
+ * @return 0 on success, -1 if the inputs couldn't be set up
+ */
+static int measure(unsigned int rate, int extra, int dither) {
+	static struct adc_oversampler os;
+	static adc_vec frames[MEASURE_FRAMES + SETTLE_FRAMES + ADC_SCAN_FRAMES];
+	const unsigned int axes[2] = { 0, 1 };
+	const int total = MEASURE_FRAMES + SETTLE_FRAMES;
+	const char * names[2] = { "x", "y" };
+	struct adc_noise noise;
+	int n = 0, c;
+
+	if (adc_oversample_init(&os, axes, 2, rate, extra, dither) < 0
+			|| adc_oversample_start(&os) < 0)
+		return -1;
+	while (n < total) {
+		usleep(1000000 / rate);
+		n += adc_oversample_read(&os, frames + n, total + ADC_SCAN_FRAMES - n);
+	}
+	adc_oversample_close(&os);
+
+	adc_noise_measure(frames + SETTLE_FRAMES, MEASURE_FRAMES, 2, ADC_BASE_BITS + extra, &noise);
+	for (c = 0; c < 2; c++)
+		printf("%4d %5d %8u %6u %6s %3s %10.2f %9.3f %9.4f %6.2f %6lu\n", noise.bits,
+				1 << (2 * extra), rate << (2 * extra), rate, dither == ADC_NO_DITHER ? "off" : "on",
+				names[c], noise.mean[c], noise.sigma[c], noise.sigma[c] / (1 << extra),
+				noise.enob[c], __atomic_load_n(&os.sampler.late, __ATOMIC_RELAXED));
+	return 0;
+} // end measure
+
+int main(int argc, char* argv[]) {
+	unsigned int rate = argc > 1 ? atoi(argv[1]) : 10;
+	int dither = argc > 2 ? atoi(argv[2]) : ADC_NO_DITHER;
+	int extra;
+
+	printf("bits ratio sample Hz out Hz dither axis       mean  sigma LSB sigma@12b   ENOB   late\n");
+	for (extra = 0; extra <= ADC_OVERSAMPLE_MAX_BITS; extra++) {
+		if (measure(rate, extra, ADC_NO_DITHER) < 0) {
+			fprintf(stderr, "Couldn't initialize AIO, exiting");
+			return MRAA_ERROR_UNSPECIFIED;
+		}
+		if (dither != ADC_NO_DITHER && measure(rate, extra, dither) < 0) {
+			fprintf(stderr, "Couldn't initialize PWM %d, exiting", dither);
+			return MRAA_ERROR_UNSPECIFIED;
+		}
+	}
+	return 0;
+} // end main
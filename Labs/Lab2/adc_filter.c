@@ -0,0 +1,193 @@
+#include <string.h>
+#include "adc_filter.h"
+
+/*
+ * Lane-wise minimum and maximum. GCC only allows ?: on vectors in C++, so the
+ * comparison mask selects the lanes instead.
+ */
+static inline adc_vec vmin(adc_vec a, adc_vec b) {
+	adc_ivec m = a < b;
+	return (adc_vec) (((adc_ivec) a & m) | ((adc_ivec) b & ~m));
+}
+
+static inline adc_vec vmax(adc_vec a, adc_vec b) {
+	adc_ivec m = a > b;
+	return (adc_vec) (((adc_ivec) a & m) | ((adc_ivec) b & ~m));
+}
+
+void adc_filter_reset(struct adc_filter * f) {
+	memset(f->history, 0, sizeof(f->history));
+	memset(f->integ, 0, sizeof(f->integ));
+	memset(f->comb, 0, sizeof(f->comb));
+	memset(&f->sum, 0, sizeof(f->sum));
+	memset(&f->state, 0, sizeof(f->state));
+	f->pos = 0;
+	f->filled = 0;
+	f->phase = 0;
+}
+
+int adc_filter_moving_average(struct adc_filter * f, int length) {
+	if (length < 1 || length > ADC_FILTER_MAX_TAPS)
+		return -1;
+	f->type = ADC_FILTER_MOVING_AVERAGE;
+	f->length = length;
+	adc_filter_reset(f);
+	return 0;
+}
+
+int adc_filter_median(struct adc_filter * f, int length) {
+	if (length < 1 || length > ADC_FILTER_MAX_TAPS || length % 2 == 0)
+		return -1;
+	f->type = ADC_FILTER_MEDIAN;
+	f->length = length;
+	adc_filter_reset(f);
+	return 0;
+}
+
+int adc_filter_iir(struct adc_filter * f, float alpha) {
+	if (alpha <= 0 || alpha > 1)
+		return -1;
+	f->type = ADC_FILTER_IIR;
+	f->alpha = alpha;
+	adc_filter_reset(f);
+	return 0;
+}
+
+int adc_filter_cic(struct adc_filter * f, int ratio, int stages) {
+	int bits = 12, s, r;
+	float gain = 1;
+
+	if (ratio < 1 || stages < 1 || stages > ADC_FILTER_MAX_STAGES)
+		return -1;
+	for (s = 0; s < stages; s++) {
+		for (r = 1; r < ratio; r <<= 1)
+			bits++;
+		gain *= ratio;
+	}
+	if (bits > 31)
+		return -1; // the integrators may wrap, but the output has to fit
+
+	f->type = ADC_FILTER_CIC;
+	f->length = ratio;
+	f->stages = stages;
+	f->alpha = 1 / gain;
+	adc_filter_reset(f);
+	return 0;
+}
+
+static int moving_average(struct adc_filter * f, const adc_vec * in, int n, adc_vec * out) {
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		adc_vec x = in[i];
+		f->sum += x - f->history[f->pos];
+		f->history[f->pos] = x;
+		if (f->filled < f->length)
+			f->filled++;
+		if (++f->pos == f->length) {
+			f->pos = 0;
+			// resum once per window so float rounding can't accumulate
+			f->sum = f->history[0];
+			for (k = 1; k < f->length; k++)
+				f->sum += f->history[k];
+		}
+		out[i] = f->sum / (float) f->filled;
+	}
+	return n;
+}
+
+static int median(struct adc_filter * f, const adc_vec * in, int n, adc_vec * out) {
+	adc_vec w[ADC_FILTER_MAX_TAPS];
+	int i, pass, k;
+
+	for (i = 0; i < n; i++) {
+		f->history[f->pos] = in[i];
+		f->pos = (f->pos + 1) % f->length;
+		if (f->filled < f->length)
+			f->filled++;
+
+		// odd-even transposition sort: sorts every lane at once
+		memcpy(w, f->history, f->filled * sizeof(adc_vec));
+		for (pass = 0; pass < f->filled; pass++) {
+			for (k = pass & 1; k + 1 < f->filled; k += 2) {
+				adc_vec lo = vmin(w[k], w[k + 1]);
+				w[k + 1] = vmax(w[k], w[k + 1]);
+				w[k] = lo;
+			}
+		}
+		out[i] = w[f->filled / 2];
+	}
+	return n;
+}
+
+static int iir(struct adc_filter * f, const adc_vec * in, int n, adc_vec * out) {
+	int i = 0;
+
+	if (n > 0 && f->filled == 0) {
+		f->state = in[0];
+		f->filled = 1;
+		out[i++] = f->state;
+	}
+	for (; i < n; i++) {
+		f->state += f->alpha * (in[i] - f->state);
+		out[i] = f->state;
+	}
+	return n;
+}
+
+static int cic(struct adc_filter * f, const adc_vec * in, int n, adc_vec * out) {
+	int i, s, c, outputs = 0;
+
+	for (i = 0; i < n; i++) {
+		adc_ivec x;
+		for (c = 0; c < ADC_MAX_CHANNELS; c++)
+			x[c] = (int32_t) (in[i][c] + 0.5f);
+
+		// integrators run at the input rate; wrapping is harmless in two's complement
+		f->integ[0] += x;
+		for (s = 1; s < f->stages; s++)
+			f->integ[s] += f->integ[s - 1];
+
+		if (++f->phase < f->length)
+			continue;
+		f->phase = 0;
+
+		// combs run at the output rate
+		x = f->integ[f->stages - 1];
+		for (s = 0; s < f->stages; s++) {
+			adc_ivec delayed = f->comb[s];
+			f->comb[s] = x;
+			x -= delayed;
+		}
+		for (c = 0; c < ADC_MAX_CHANNELS; c++)
+			out[outputs][c] = x[c] * f->alpha;
+		outputs++;
+	}
+	return outputs;
+}
+
+int adc_filter_run(struct adc_filter * f, const adc_vec * in, int n, adc_vec * out) {
+	switch (f->type) {
+	case ADC_FILTER_MOVING_AVERAGE:
+		return moving_average(f, in, n, out);
+	case ADC_FILTER_MEDIAN:
+		return median(f, in, n, out);
+	case ADC_FILTER_IIR:
+		return iir(f, in, n, out);
+	case ADC_FILTER_CIC:
+		return cic(f, in, n, out);
+	}
+	return 0;
+}
+
+int adc_filter_load(const struct adc_scan * scan, adc_vec * out) {
+	int i, c;
+
+	for (i = 0; i < scan->count; i++) {
+		adc_vec v = { 0 };
+		for (c = 0; c < scan->channels; c++)
+			v[c] = scan->value[c][i];
+		out[i] = v;
+	}
+	return scan->count;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file
+ * @brief Streaming filters for blocks of accelerometer frames. Every channel of a
+ * frame is one lane of a vector (GCC vector extensions), so each filter step works
+ * on all channels at once with SIMD instructions where the CPU has them (SSE on the
+ * Edison's Atom).
+ *
+ * Filters keep their state between calls, so a stream can be fed in blocks of any
+ * size:
+ * 		moving average	Mean of the last N frames
+ * 		median			Median of the last N frames, which rejects single spikes
+ * 		IIR				One-pole low-pass: y += alpha * (x - y)
+ * 		CIC				Cascaded integrator-comb decimator: averages and outputs
+ * 						one frame for every R frames in
+ *
+ * e.g.: adc_vec in[ADC_SCAN_FRAMES], out[ADC_SCAN_FRAMES];
+ * 		 struct adc_filter average;
+ * 		 adc_filter_moving_average(&average, 16);
+ * 		 n = adc_filter_load(&scan, in);
+ * 		 n = adc_filter_run(&average, in, n, out);
+ * 		 ... out[i][c] is channel c of frame i ...
+ */
+
+#ifndef ADC_FILTER_H_
+#define ADC_FILTER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "adc_sampler.h"
+
+/**
+ * One frame, one channel per lane
+ */
+typedef float adc_vec __attribute__((vector_size(ADC_MAX_CHANNELS * sizeof(float))));
+typedef int32_t adc_ivec __attribute__((vector_size(ADC_MAX_CHANNELS * sizeof(int32_t))));
+
+/**
+ * Longest moving average or median window
+ */
+#define ADC_FILTER_MAX_TAPS		32
+
+/**
+ * Most integrator/comb stages of a CIC filter
+ */
+#define ADC_FILTER_MAX_STAGES	5
+
+enum adc_filter_type {
+	ADC_FILTER_MOVING_AVERAGE,
+	ADC_FILTER_MEDIAN,
+	ADC_FILTER_IIR,
+	ADC_FILTER_CIC
+};
+
+/**
+ * State of one filter. Treat the members as private.
+ * 		type			Which filter this is
+ * 		length			Window length (moving average, median) or decimation ratio (CIC)
+ * 		stages			Number of CIC stages
+ * 		alpha			IIR coefficient, or 1 / R^stages to undo the CIC gain
+ * 		pos, filled		Next history slot and number of slots holding frames
+ * 		history			Last frames in (moving average, median)
+ * 		sum				Running sum of the history (moving average)
+ * 		state			Last output (IIR)
+ * 		integ, comb		Integrator outputs and comb delays (CIC)
+ * 		phase			Frames into the current CIC output
+ */
+struct adc_filter {
+	enum adc_filter_type type;
+	int length;
+	int stages;
+	float alpha;
+	int pos, filled;
+	adc_vec history[ADC_FILTER_MAX_TAPS];
+	adc_vec sum;
+	adc_vec state;
+	adc_ivec integ[ADC_FILTER_MAX_STAGES];
+	adc_ivec comb[ADC_FILTER_MAX_STAGES];
+	int phase;
+};
+
+/**
+ * Set up a moving average of the last N frames.
+ *
+ * @param adc_filter The filter to initialize
+ * @param int        Window length (1 to ADC_FILTER_MAX_TAPS)
+ *
+ * @return 0 on success, -1 if the length is out of range
+ */
+int adc_filter_moving_average(struct adc_filter*, int);
+
+/**
+ * Set up a median of the last N frames.
+ *
+ * @param adc_filter The filter to initialize
+ * @param int        Window length (odd, 1 to ADC_FILTER_MAX_TAPS)
+ *
+ * @return 0 on success, -1 if the length is out of range or even
+ */
+int adc_filter_median(struct adc_filter*, int);
+
+/**
+ * Set up a one-pole IIR low-pass. The first frame in sets the starting output.
+ *
+ * @param adc_filter The filter to initialize
+ * @param float      Coefficient between 0 and 1; smaller is smoother
+ *
+ * @return 0 on success, -1 if alpha is out of range
+ */
+int adc_filter_iir(struct adc_filter*, float);
+
+/**
+ * Set up a CIC decimator. Its input must be whole counts (raw readings), and the
+ * bit growth of 12 + stages * log2(ratio) must fit in 31 bits.
+ *
+ * @param adc_filter The filter to initialize
+ * @param int        Decimation ratio R
+ * @param int        Number of stages (1 to ADC_FILTER_MAX_STAGES)
+ *
+ * @return 0 on success, -1 if the configuration would overflow
+ */
+int adc_filter_cic(struct adc_filter*, int, int);
+
+/**
+ * Clear the filter's history, keeping its configuration.
+ *
+ * @param adc_filter The filter to reset
+ */
+void adc_filter_reset(struct adc_filter*);
+
+/**
+ * Filter a block of frames.
+ *
+ * @param adc_filter The filter to run
+ * @param adc_vec*   Frames in
+ * @param int        Number of frames in
+ * @param adc_vec*   Frames out (may be the same array as the input)
+ *
+ * @return Number of frames out: the same as in, or fewer for a CIC decimator
+ */
+int adc_filter_run(struct adc_filter*, const adc_vec*, int, adc_vec*);
+
+/**
+ * Convert a scan block into one vector per frame. Lanes past the scan's channel count
+ * are zero.
+ *
+ * @param adc_scan The block to convert
+ * @param adc_vec* Frames out (ADC_SCAN_FRAMES long)
+ *
+ * @return Number of frames
+ */
+int adc_filter_load(const struct adc_scan*, adc_vec*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ADC_FILTER_H_ */
@@ -0,0 +1,33 @@
+#include <math.h>
+#include "adc_lut.h"
+
+static const float pi = 3.1415926535897;
+
+/*
+ * Normalize a reading to +-1g; below 0g it is scaled by the negative half of the
+ * range, above by the positive half.
+ */
+static float normalize(float reading, float middle, float max, float min) {
+	return reading > middle ? (reading - middle) / (max - middle) : (reading - middle) / (middle - min);
+}
+
+int adc_lut_init(struct adc_lut * lut, int bits, float zero, float pos, float neg) {
+	unsigned int i, size;
+	float step;
+
+	if (bits < 12 || bits > ADC_LUT_MAX_BITS)
+		return -1; // the table couldn't be indexed by every reading
+	lut->bits = bits;
+	size = 1 << bits;
+	step = 1.0f / (1 << (bits - 12)); // one count in 12-bit counts
+
+	for (i = 0; i < size; i++) {
+		float g = normalize(i * step, zero, pos, neg);
+		// past 1g the axis is beyond vertical, which is as far from level as it gets
+		float tilt = g >= 1 ? 90 : g <= -1 ? -90 : asinf(g) * (180 / pi);
+
+		lut->g[i] = g;
+		lut->tilt[i] = tilt;
+	}
+	return 0;
+}
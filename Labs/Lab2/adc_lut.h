@@ -0,0 +1,60 @@
+/**
+ * @file
+ * @brief Conversion tables for one accelerometer axis. A 12-bit reading has only 4096
+ * possible values, so everything derived from it (acceleration in g and tilt in
+ * degrees) is computed once for every count when the table is built, and each sample
+ * afterwards costs a table load. Tables can also be built for oversampled readings of
+ * up to ADC_LUT_MAX_BITS. Level bands are left to level_state.h, which classifies
+ * both axes together with hysteresis.
+ *
+ * e.g.: struct adc_lut x;
+ * 		 adc_lut_init(&x, 12, xZeroG, xPosG, xNegG);
+ * 		 float g = x.g[reading];
+ */
+
+#ifndef ADC_LUT_H_
+#define ADC_LUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Highest reading resolution a table can cover, and its number of entries: one per
+ * count of a 14-bit reading (12 bits oversampled by 16)
+ */
+#define ADC_LUT_MAX_BITS	14
+#define ADC_LUT_SIZE		(1 << ADC_LUT_MAX_BITS)
+
+/**
+ * Tables for one axis, indexed by the raw reading.
+ * 		bits	Resolution of the readings; entries from 1 << bits on are unused
+ * 		g		Acceleration normalized to +-1g
+ * 		tilt	Tilt of the axis from level in degrees (+-90 once past 1g)
+ */
+struct adc_lut {
+	int bits;
+	float g[ADC_LUT_SIZE];
+	float tilt[ADC_LUT_SIZE];
+};
+
+/**
+ * Build the tables of an axis from its calibration readings. The calibration is in
+ * 12-bit counts whatever the resolution of the table.
+ *
+ * @param adc_lut The tables to fill
+ * @param int     Resolution of the readings in bits (12 to ADC_LUT_MAX_BITS)
+ * @param float   Reading at 0g (level)
+ * @param float   Reading at +1g
+ * @param float   Reading at -1g
+ *
+ * @return 0 on success, -1 if the resolution is outside 12 to ADC_LUT_MAX_BITS
+ */
+int adc_lut_init(struct adc_lut*, int, float, float, float);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ADC_LUT_H_ */
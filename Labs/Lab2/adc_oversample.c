@@ -0,0 +1,89 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "adc_oversample.h"
+
+int adc_oversample_init(struct adc_oversampler * os, const unsigned int * pins, int channels,
+		unsigned int out_rate_hz, int extra_bits, int dither_pin) {
+	int ratio;
+
+	if (extra_bits < 0 || extra_bits > ADC_OVERSAMPLE_MAX_BITS || out_rate_hz == 0)
+		return -1;
+
+	ratio = 1 << (2 * extra_bits);
+	os->extra_bits = extra_bits;
+	os->out_rate_hz = out_rate_hz;
+	os->dither = NULL;
+	memset(&os->scan, 0, sizeof(os->scan));
+	if (adc_filter_cic(&os->decimate, ratio, 1) < 0)
+		return -1;
+	if (adc_sampler_init(&os->sampler, pins, channels, out_rate_hz * ratio, ADC_BASE_BITS) < 0)
+		return -1;
+
+	if (dither_pin != ADC_NO_DITHER) {
+		os->dither = mraa_pwm_init(dither_pin);
+		if (os->dither == NULL) {
+			fprintf(stderr, "Couldn't initialize PWM %d for dither\n", dither_pin);
+			adc_sampler_close(&os->sampler);
+			return -1;
+		}
+		mraa_pwm_period_us(os->dither, ADC_DITHER_PERIOD_US);
+		mraa_pwm_write(os->dither, 0.5f);
+	}
+	return 0;
+}
+
+int adc_oversample_start(struct adc_oversampler * os) {
+	if (os->dither != NULL)
+		mraa_pwm_enable(os->dither, 1);
+	return adc_sampler_start(&os->sampler);
+}
+
+int adc_oversample_read(struct adc_oversampler * os, adc_vec * out, int max) {
+	adc_vec frames[ADC_SCAN_FRAMES];
+	float scale = 1 << os->extra_bits;
+	int ratio = os->decimate.length;
+	int stored = 0, n, i;
+
+	// one scan block gives at most ceil(ADC_SCAN_FRAMES / ratio) outputs
+	while (stored + (ADC_SCAN_FRAMES + ratio - 1) / ratio <= max
+			&& adc_sampler_available(&os->sampler) > 0) {
+		adc_sampler_scan(&os->sampler, &os->scan);
+		n = adc_filter_load(&os->scan, frames);
+		n = adc_filter_run(&os->decimate, frames, n, frames);
+		for (i = 0; i < n; i++)
+			out[stored++] = frames[i] * scale; // mean of 4^k readings, times 2^k
+	}
+	return stored;
+}
+
+void adc_oversample_close(struct adc_oversampler * os) {
+	adc_sampler_close(&os->sampler);
+	if (os->dither != NULL) {
+		mraa_pwm_enable(os->dither, 0);
+		mraa_pwm_close(os->dither);
+		os->dither = NULL;
+	}
+}
+
+void adc_noise_measure(const adc_vec * frames, int n, int channels, int bits,
+		struct adc_noise * noise) {
+	// quantization noise of an ideal converter is 1/sqrt(12) counts
+	const double ideal = 1 / sqrt(12);
+	int i, c;
+
+	noise->bits = bits;
+	for (c = 0; c < channels; c++) {
+		double sum = 0, squares = 0, mean;
+		for (i = 0; i < n; i++)
+			sum += frames[i][c];
+		mean = n > 0 ? sum / n : 0;
+		for (i = 0; i < n; i++)
+			squares += (frames[i][c] - mean) * (frames[i][c] - mean);
+
+		noise->mean[c] = mean;
+		noise->sigma[c] = n > 1 ? sqrt(squares / (n - 1)) : 0;
+		// quieter than quantization means the output resolution is the limit
+		noise->enob[c] = noise->sigma[c] > ideal ? bits - log2(noise->sigma[c] / ideal) : bits;
+	}
+}
@@ -0,0 +1,143 @@
+/**
+ * @file
+ * @brief Oversampling mode for the ADC. Channels are sampled 4^k times faster than
+ * the output rate and each run of 4^k frames is summed and scaled down by 2^k, which
+ * gives k extra bits of resolution as long as there is at least about one count of
+ * noise on the input to spread readings across neighbouring codes. When the input is
+ * too quiet, a PWM pin can add that noise (dither): drive it through a large resistor
+ * (about 1 MΩ) into the analog input so it moves the reading by a count or two.
+ *
+ * adc_noise_measure() reports the noise floor and effective number of bits of a run
+ * of output frames taken with the input held still, so each configuration's trade of
+ * rate against resolution can be checked.
+ *
+ * e.g.: struct adc_oversampler os;
+ * 		 adc_oversample_init(&os, pins, 2, 100, 2, ADC_NO_DITHER); // 14 bits at 100 Hz
+ * 		 adc_oversample_start(&os);
+ * 		 n = adc_oversample_read(&os, frames, ADC_SCAN_FRAMES);
+ */
+
+#ifndef ADC_OVERSAMPLE_H_
+#define ADC_OVERSAMPLE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mraa.h"
+#include "adc_sampler.h"
+#include "adc_filter.h"
+
+/**
+ * Most extra bits: 4 gives 16-bit output from 256 frames per output
+ */
+#define ADC_OVERSAMPLE_MAX_BITS	4
+
+/**
+ * Resolution of a plain reading
+ */
+#define ADC_BASE_BITS			12
+
+/**
+ * Pass as the dither pin to sample without dither
+ */
+#define ADC_NO_DITHER			-1
+
+/**
+ * Dither PWM period. It isn't a multiple of any sampling period used here, so the
+ * dither phase moves across the frames that are summed together.
+ */
+#define ADC_DITHER_PERIOD_US	1370
+
+/**
+ * State of an oversampling reader.
+ * 		sampler		Sampler running at 4^extra_bits times the output rate
+ * 		scan		Block the sampler's frames are aligned in
+ * 		decimate	Single-stage CIC summing each run of frames
+ * 		extra_bits	Bits added to ADC_BASE_BITS
+ * 		out_rate_hz	Output frames per second
+ * 		dither		PWM dither output, or NULL
+ */
+struct adc_oversampler {
+	struct adc_sampler sampler;
+	struct adc_scan scan;
+	struct adc_filter decimate;
+	int extra_bits;
+	unsigned int out_rate_hz;
+	mraa_pwm_context dither;
+};
+
+/**
+ * Noise of a run of frames taken with the input held still.
+ * 		bits	Resolution of the frames
+ * 		mean	Mean reading of each channel
+ * 		sigma	Standard deviation of each channel in counts at that resolution; the
+ * 				noise floor
+ * 		enob	Effective number of bits of each channel: the resolution of an ideal
+ * 				ADC whose quantization noise equals the measured noise
+ */
+struct adc_noise {
+	int bits;
+	double mean[ADC_MAX_CHANNELS];
+	double sigma[ADC_MAX_CHANNELS];
+	double enob[ADC_MAX_CHANNELS];
+};
+
+/**
+ * Set up oversampled reading of the analog pins.
+ *
+ * @param adc_oversampler The reader to initialize
+ * @param unsigned int*   The analog pins to scan
+ * @param int             Number of pins (at most ADC_MAX_CHANNELS)
+ * @param unsigned int    Output frames per second
+ * @param int             Extra bits (0 to ADC_OVERSAMPLE_MAX_BITS)
+ * @param int             PWM pin for dither, or ADC_NO_DITHER
+ *
+ * @return 0 on success, -1 on failure
+ */
+int adc_oversample_init(struct adc_oversampler*, const unsigned int*, int, unsigned int, int,
+		int);
+
+/**
+ * Start sampling (and dithering).
+ *
+ * @param adc_oversampler The reader to start
+ *
+ * @return 0 on success, -1 if the sampling thread couldn't be created
+ */
+int adc_oversample_start(struct adc_oversampler*);
+
+/**
+ * Take the output frames that are ready. Values are in counts of ADC_BASE_BITS +
+ * extra_bits resolution, so 4 times the plain reading for 2 extra bits.
+ *
+ * @param adc_oversampler The reader to read from
+ * @param adc_vec*        Where to store the frames
+ * @param int             Most frames to store
+ *
+ * @return Number of frames stored
+ */
+int adc_oversample_read(struct adc_oversampler*, adc_vec*, int);
+
+/**
+ * Stop sampling and release the pins.
+ *
+ * @param adc_oversampler The reader to close
+ */
+void adc_oversample_close(struct adc_oversampler*);
+
+/**
+ * Measure the noise floor and ENOB of a run of frames.
+ *
+ * @param adc_vec*  The frames, taken with the input held still
+ * @param int       Number of frames
+ * @param int       Number of channels to measure
+ * @param int       Resolution of the frames in bits
+ * @param adc_noise Filled in with the results
+ */
+void adc_noise_measure(const adc_vec*, int, int, int, struct adc_noise*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ADC_OVERSAMPLE_H_ */
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "adc_sampler.h"
+
+#define IIO_DEVICES "/sys/bus/iio/devices"
+
+/*
+ * Current time in nanoseconds from the monotonic clock.
+ */
+static uint64_t now_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/*
+ * Add one frame to the ring. Only the sampling thread calls this.
+ */
+static void push(struct adc_sampler * s, const struct adc_frame * frame) {
+	uint32_t head = s->ring.head;
+	uint32_t tail = __atomic_load_n(&s->ring.tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail == ADC_RING_FRAMES) { // reader fell behind: keep the older data
+		__atomic_add_fetch(&s->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	s->ring.frames[head & (ADC_RING_FRAMES - 1)] = *frame;
+	__atomic_store_n(&s->ring.head, head + 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&s->frames, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Sampling thread for the MRAA backend. Sleeps to absolute deadlines one period
+ * apart so time spent reading doesn't stretch the spacing; missed deadlines are
+ * counted and skipped rather than made up in a burst.
+ */
+static void * sample_mraa(void * args) {
+	struct adc_sampler * s = (struct adc_sampler *) args;
+	struct adc_frame frame;
+	struct timespec wake;
+	uint64_t next = now_ns(), now;
+	int c, value;
+
+	memset(&frame, 0, sizeof(frame));
+	while (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE) == 0) {
+		frame.t_ns = now_ns();
+		for (c = 0; c < s->channels; c++) {
+			if (c > 0)
+				frame.skew_ns[c] = (uint32_t) (now_ns() - frame.t_ns);
+			value = mraa_aio_read(s->aio[c]);
+			if (value < 0)
+				break; // a failed read is -1, not a reading: drop the frame
+			frame.value[c] = (uint16_t) value;
+		}
+		if (c == s->channels)
+			push(s, &frame);
+		else
+			__atomic_add_fetch(&s->failed, 1, __ATOMIC_RELAXED);
+
+		next += s->period_ns;
+		now = now_ns();
+		if (now >= next) {
+			uint64_t missed = (now - next) / s->period_ns + 1;
+			__atomic_add_fetch(&s->late, missed, __ATOMIC_RELAXED);
+			next += missed * s->period_ns;
+		}
+		wake.tv_sec = next / 1000000000ULL;
+		wake.tv_nsec = next % 1000000000ULL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+			;
+	}
+	return NULL;
+}
+
+/*
+ * Sampling thread for the IIO backend. The kernel paces the scans; this thread only
+ * unpacks them into frames. The ADC converts a scan in a few microseconds, so no skew
+ * is recorded.
+ */
+static void * sample_iio(void * args) {
+	struct adc_sampler * s = (struct adc_sampler *) args;
+	unsigned char buf[64 * 32];
+	struct adc_frame frame;
+	struct pollfd pfd;
+	int n, i, c;
+
+	memset(&frame, 0, sizeof(frame));
+	pfd.fd = s->iio_fd;
+	pfd.events = POLLIN;
+	while (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE) == 0) {
+		if (poll(&pfd, 1, 100) <= 0)
+			continue; // timed out: check for stop
+		n = read(s->iio_fd, buf, sizeof(buf) - sizeof(buf) % s->scan_bytes);
+		if (n <= 0)
+			continue;
+		for (i = 0; i + s->scan_bytes <= n; i += s->scan_bytes) {
+			unsigned char * scan = buf + i;
+			int64_t ts;
+			for (c = 0; c < s->channels; c++) {
+				uint16_t raw;
+				memcpy(&raw, scan + s->iio_offset[c], sizeof(raw));
+				frame.value[c] = (raw >> s->iio_shift[c]) & ((1 << s->iio_bits[c]) - 1);
+			}
+			memcpy(&ts, scan + s->ts_offset, sizeof(ts));
+			frame.t_ns = (uint64_t) ts;
+			push(s, &frame);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Write a value to a sysfs attribute.
+ */
+static int write_attr(const char * path, const char * value) {
+	int fd = open(path, O_WRONLY);
+	int ok;
+	if (fd < 0)
+		return -1;
+	ok = write(fd, value, strlen(value)) == (ssize_t) strlen(value);
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+/*
+ * Read a sysfs attribute into buf, without the trailing newline.
+ */
+static int read_attr(const char * path, char * buf, int size) {
+	int fd = open(path, O_RDONLY), n;
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	if (buf[n - 1] == '\n')
+		buf[n - 1] = '\0';
+	return 0;
+}
+
+int adc_sampler_init(struct adc_sampler * s, const unsigned int * pins, int channels,
+		unsigned int rate_hz, int bits) {
+	int c;
+
+	if (channels < 1 || channels > ADC_MAX_CHANNELS || rate_hz == 0)
+		return -1;
+
+	memset(s, 0, sizeof(*s));
+	s->backend = ADC_BACKEND_MRAA;
+	s->iio_fd = -1;
+	s->channels = channels;
+	s->rate_hz = rate_hz;
+	s->period_ns = 1000000000ULL / rate_hz;
+	for (c = 0; c < channels; c++) {
+		s->pins[c] = pins[c];
+		s->aio[c] = mraa_aio_init(pins[c]);
+		if (s->aio[c] == NULL) {
+			fprintf(stderr, "Couldn't initialize AIO %u\n", pins[c]);
+			while (--c >= 0)
+				mraa_aio_close(s->aio[c]);
+			return -1;
+		}
+		mraa_aio_set_bit(s->aio[c], bits);
+	}
+	return 0;
+}
+
+int adc_sampler_init_iio(struct adc_sampler * s, int device, const unsigned int * pins,
+		int channels, unsigned int rate_hz, const char * trigger) {
+	char path[128], value[64];
+	int c, k, offset = 0;
+
+	if (channels < 1 || channels > ADC_MAX_CHANNELS || rate_hz == 0)
+		return -1;
+
+	memset(s, 0, sizeof(*s));
+	s->backend = ADC_BACKEND_IIO;
+	s->iio_fd = -1;
+	s->iio_device = device;
+	s->channels = channels;
+	s->rate_hz = rate_hz;
+	s->period_ns = 1000000000ULL / rate_hz;
+
+	snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/buffer/enable", device);
+	if (write_attr(path, "0") < 0)
+		return -1; // no triggered buffer on this device
+
+	// enable only the requested channels plus the timestamp
+	for (k = 0; k < 16; k++) {
+		int wanted = 0;
+		for (c = 0; c < channels; c++)
+			wanted |= pins[c] == (unsigned int) k;
+		snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/scan_elements/in_voltage%d_en",
+				device, k);
+		if (write_attr(path, wanted ? "1" : "0") < 0 && wanted)
+			return -1;
+	}
+	snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/scan_elements/in_timestamp_en", device);
+	if (write_attr(path, "1") < 0)
+		return -1;
+	snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/current_timestamp_clock", device);
+	write_attr(path, "monotonic"); // older kernels only have one clock
+
+	// scans hold the enabled channels in index order, then the 8-byte aligned timestamp
+	for (k = 0; k < 16; k++) {
+		for (c = 0; c < channels; c++) {
+			int bits = 12, storage = 16, shift = 0;
+			if (pins[c] != (unsigned int) k)
+				continue;
+			snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/scan_elements/in_voltage%d_type",
+					device, k);
+			if (read_attr(path, value, sizeof(value)) == 0) // e.g. "le:u12/16>>0"
+				sscanf(value, "%*[^:]:%*c%d/%d>>%d", &bits, &storage, &shift);
+			if (storage != 16)
+				return -1; // only 16-bit storage is unpacked
+			s->iio_offset[c] = offset;
+			s->iio_shift[c] = shift;
+			s->iio_bits[c] = bits;
+			offset += 2;
+		}
+	}
+	s->ts_offset = (offset + 7) & ~7;
+	s->scan_bytes = s->ts_offset + 8;
+
+	// attach the trigger and set its rate
+	for (k = 0; k < 16; k++) {
+		snprintf(path, sizeof(path), IIO_DEVICES "/trigger%d/name", k);
+		if (read_attr(path, value, sizeof(value)) == 0 && strcmp(value, trigger) == 0) {
+			snprintf(path, sizeof(path), IIO_DEVICES "/trigger%d/sampling_frequency", k);
+			snprintf(value, sizeof(value), "%u", rate_hz);
+			write_attr(path, value);
+			break;
+		}
+	}
+	snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/trigger/current_trigger", device);
+	if (write_attr(path, trigger) < 0)
+		return -1;
+	snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/buffer/length", device);
+	write_attr(path, "256");
+
+	snprintf(path, sizeof(path), "/dev/iio:device%d", device);
+	s->iio_fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (s->iio_fd < 0)
+		return -1;
+	snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/buffer/enable", device);
+	if (write_attr(path, "1") < 0) {
+		close(s->iio_fd);
+		s->iio_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+int adc_sampler_start(struct adc_sampler * s) {
+	void * (*loop)(void *) = s->backend == ADC_BACKEND_IIO ? &sample_iio : &sample_mraa;
+	__atomic_store_n(&s->stop, 0, __ATOMIC_RELEASE);
+	if (pthread_create(&s->thread, NULL, loop, s) != 0)
+		return -1;
+	s->started = 1;
+	return 0;
+}
+
+int adc_sampler_read(struct adc_sampler * s, struct adc_frame * out, int max) {
+	uint32_t tail = s->ring.tail;
+	uint32_t head = __atomic_load_n(&s->ring.head, __ATOMIC_ACQUIRE);
+	int n = (int) (head - tail), i;
+
+	if (n > max)
+		n = max;
+	for (i = 0; i < n; i++)
+		out[i] = s->ring.frames[(tail + i) & (ADC_RING_FRAMES - 1)];
+	__atomic_store_n(&s->ring.tail, tail + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+/*
+ * Value of a channel at the time of frame cur, interpolated between its reading in
+ * the previous frame and its (later) reading in cur.
+ */
+static uint16_t align(const struct adc_frame * prev, const struct adc_frame * cur, int c) {
+	uint64_t t0 = prev->t_ns + prev->skew_ns[c];
+	uint64_t t1 = cur->t_ns + cur->skew_ns[c];
+	int32_t v0 = prev->value[c], v1 = cur->value[c];
+
+	if (cur->skew_ns[c] == 0 || t1 <= t0 || cur->t_ns < t0)
+		return cur->value[c];
+	return (uint16_t) (v0 + ((v1 - v0) * (int64_t) (cur->t_ns - t0) + (int64_t) (t1 - t0) / 2)
+			/ (int64_t) (t1 - t0));
+}
+
+int adc_sampler_scan(struct adc_sampler * s, struct adc_scan * scan) {
+	struct adc_frame frames[ADC_SCAN_FRAMES];
+	int n = adc_sampler_read(s, frames, ADC_SCAN_FRAMES), i, c;
+
+	scan->channels = s->channels;
+	scan->count = n;
+	for (i = 0; i < n; i++) {
+		const struct adc_frame * prev = i > 0 ? &frames[i - 1] : &scan->last;
+		int first = i == 0 && !scan->have_last;
+		scan->t_ns[i] = frames[i].t_ns;
+		for (c = 0; c < s->channels; c++) {
+			scan->value[c][i] = first ? frames[i].value[c] : align(prev, &frames[i], c);
+			scan->skew_ns[c][i] = frames[i].skew_ns[c];
+		}
+	}
+	if (n > 0) {
+		scan->last = frames[n - 1];
+		scan->have_last = 1;
+	}
+	return n;
+}
+
+int adc_sampler_available(struct adc_sampler * s) {
+	return (int) (__atomic_load_n(&s->ring.head, __ATOMIC_ACQUIRE) - s->ring.tail);
+}
+
+void adc_sampler_close(struct adc_sampler * s) {
+	char path[128];
+	int c;
+
+	if (s->started) { // not when init failed before the thread was started
+		__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(s->thread, NULL);
+		s->started = 0;
+	}
+
+	if (s->backend == ADC_BACKEND_IIO) {
+		snprintf(path, sizeof(path), IIO_DEVICES "/iio:device%d/buffer/enable", s->iio_device);
+		write_attr(path, "0");
+		if (s->iio_fd >= 0)
+			close(s->iio_fd);
+		s->iio_fd = -1;
+	} else {
+		for (c = 0; c < s->channels; c++)
+			mraa_aio_close(s->aio[c]);
+	}
+}
@@ -0,0 +1,221 @@
+/**
+ * @file
+ * @brief Background sampler for the analog inputs used by the ADXL330 labs. A
+ * dedicated thread reads the configured channels at a fixed rate, paced on absolute
+ * deadlines so the spacing between samples doesn't drift, and stores timestamped
+ * frames in a lock-free single-producer/single-consumer ring. Consumers take frames
+ * out in blocks whenever suits them.
+ *
+ * Two backends are available:
+ * 		MRAA	mraa_aio_read() on each channel from the sampling thread
+ * 		IIO		the kernel's triggered buffer for the ADC (/dev/iio:deviceN), which
+ * 				samples in the kernel and hands over whole scans per read()
+ *
+ * Every channel of a frame is read back-to-back, but not at the same instant. The
+ * offset of each channel from the start of the frame is recorded with it, and
+ * adc_sampler_scan() uses it to interpolate every channel to the frame time so values
+ * from different channels can be combined as if they were taken together.
+ */
+
+#ifndef ADC_SAMPLER_H_
+#define ADC_SAMPLER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+#include "mraa.h"
+
+/**
+ * Most analog channels one sampler can scan
+ */
+#define ADC_MAX_CHANNELS	4
+
+/**
+ * Frames the ring can hold (must be a power of two). At 1 kHz this is about one
+ * second of data.
+ */
+#define ADC_RING_FRAMES		1024
+
+/**
+ * Frames in one adc_scan block
+ */
+#define ADC_SCAN_FRAMES		64
+
+/**
+ * One sample of every channel.
+ * 		t_ns	Time the frame was taken (CLOCK_MONOTONIC, nanoseconds); this is when
+ * 				the first channel was read
+ * 		value	Raw reading of each channel, in the order the channels were given
+ * 		skew_ns	Time each channel was read after t_ns
+ */
+struct adc_frame {
+	uint64_t t_ns;
+	uint16_t value[ADC_MAX_CHANNELS];
+	uint32_t skew_ns[ADC_MAX_CHANNELS];
+};
+
+/**
+ * A block of frames laid out channel by channel, with every channel interpolated to
+ * the frame times so value[x][i] and value[y][i] describe the same instant.
+ * 		channels	Number of channels in the block
+ * 		count		Number of frames in the block
+ * 		t_ns		Time of each frame
+ * 		value		Time-aligned reading of each channel, per frame
+ * 		skew_ns		Read offset that was corrected for, per channel and frame
+ * 		last		Final raw frame of the previous block, the starting point for
+ * 					interpolating the first frame of the next one
+ * 		have_last	Whether last holds a frame yet
+ */
+struct adc_scan {
+	int channels;
+	int count;
+	uint64_t t_ns[ADC_SCAN_FRAMES];
+	uint16_t value[ADC_MAX_CHANNELS][ADC_SCAN_FRAMES];
+	uint32_t skew_ns[ADC_MAX_CHANNELS][ADC_SCAN_FRAMES];
+	struct adc_frame last;
+	int have_last;
+};
+
+/**
+ * Lock-free ring of frames with one writer (the sampling thread) and one reader.
+ */
+struct adc_ring {
+	uint32_t head;
+	uint32_t tail;
+	struct adc_frame frames[ADC_RING_FRAMES];
+};
+
+/**
+ * Where the samples come from
+ */
+enum adc_backend {
+	ADC_BACKEND_MRAA,
+	ADC_BACKEND_IIO
+};
+
+/**
+ * State of a sampler. Treat the members as private; use the functions below.
+ * 		backend, channels, pins		What is sampled
+ * 		aio							MRAA contexts of the channels (MRAA backend)
+ * 		iio_*, scan_bytes, ts_offset	Triggered buffer layout (IIO backend): the byte
+ * 									offset, shift and width of each channel in a scan
+ * 		rate_hz, period_ns			Sampling rate
+ * 		started						Whether the sampling thread is running
+ * 		frames						Frames stored
+ * 		dropped						Frames lost because the ring was full
+ * 		late						Deadlines missed by the sampling thread
+ * 		failed						Frames dropped because a channel couldn't be read
+ * The sampling thread updates the four counts atomically; read them from other
+ * threads with __atomic_load_n().
+ */
+struct adc_sampler {
+	enum adc_backend backend;
+	int channels;
+	unsigned int pins[ADC_MAX_CHANNELS];
+	mraa_aio_context aio[ADC_MAX_CHANNELS];
+	int iio_fd;
+	int iio_device;
+	int iio_offset[ADC_MAX_CHANNELS];
+	int iio_shift[ADC_MAX_CHANNELS];
+	int iio_bits[ADC_MAX_CHANNELS];
+	int scan_bytes;
+	int ts_offset;
+	unsigned int rate_hz;
+	uint64_t period_ns;
+	pthread_t thread;
+	uint8_t started;
+	uint8_t stop;
+	unsigned long frames;
+	unsigned long dropped;
+	unsigned long late;
+	unsigned long failed;
+	struct adc_ring ring;
+};
+
+/**
+ * Set up a sampler reading the analog pins through MRAA.
+ *
+ * @param adc_sampler   The sampler to initialize
+ * @param unsigned int* The analog pins to scan (0 = A0, 1 = A1, ...)
+ * @param int           Number of pins (at most ADC_MAX_CHANNELS)
+ * @param unsigned int  Frames per second
+ * @param int           ADC resolution in bits (e.g. 12)
+ *
+ * @return 0 on success, -1 if a pin couldn't be initialized
+ */
+int adc_sampler_init(struct adc_sampler*, const unsigned int*, int, unsigned int, int);
+
+/**
+ * Set up a sampler using the kernel IIO triggered buffer of an ADC. The trigger
+ * (for example an hrtimer trigger) must already exist; its sampling frequency is set
+ * to the requested rate.
+ *
+ * @param adc_sampler   The sampler to initialize
+ * @param int           IIO device number (N in /dev/iio:deviceN)
+ * @param unsigned int* The voltage channels to scan (N in in_voltageN_raw)
+ * @param int           Number of channels (at most ADC_MAX_CHANNELS)
+ * @param unsigned int  Frames per second
+ * @param char*         Name of the trigger to attach
+ *
+ * @return 0 on success, -1 if the buffer couldn't be set up (fall back to MRAA)
+ */
+int adc_sampler_init_iio(struct adc_sampler*, int, const unsigned int*, int, unsigned int,
+		const char*);
+
+/**
+ * Start the sampling thread.
+ *
+ * @param adc_sampler The sampler to start
+ *
+ * @return 0 on success, -1 if the thread couldn't be created
+ */
+int adc_sampler_start(struct adc_sampler*);
+
+/**
+ * Take up to the given number of frames out of the ring, oldest first. Never blocks.
+ *
+ * @param adc_sampler The sampler to read from
+ * @param adc_frame   Where to copy the frames
+ * @param int         Most frames to copy
+ *
+ * @return Number of frames copied
+ */
+int adc_sampler_read(struct adc_sampler*, struct adc_frame*, int);
+
+/**
+ * Take up to ADC_SCAN_FRAMES frames out of the ring into a channel-major block, with
+ * each channel's read offset corrected by linear interpolation between neighbouring
+ * frames. The block keeps the final frame for the next call, so zero it before the
+ * first scan.
+ *
+ * @param adc_sampler The sampler to read from
+ * @param adc_scan    The block to fill
+ *
+ * @return Number of frames in the block
+ */
+int adc_sampler_scan(struct adc_sampler*, struct adc_scan*);
+
+/**
+ * Number of frames waiting in the ring.
+ *
+ * @param adc_sampler The sampler to check
+ *
+ * @return Frames available to adc_sampler_read()
+ */
+int adc_sampler_available(struct adc_sampler*);
+
+/**
+ * Stop the sampling thread, if it was started, and release the channels. Also
+ * safe on a sampler whose initialization succeeded but which was never started.
+ *
+ * @param adc_sampler The sampler to close
+ */
+void adc_sampler_close(struct adc_sampler*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ADC_SAMPLER_H_ */
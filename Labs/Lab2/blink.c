@@ -1,6 +1,8 @@
 #include "mraa.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include "../Lab6/gpio_out.h"
 
 /*
  * CS490 Lab-2 Part-1
@@ -27,26 +29,36 @@ int main(int argc, char* argv[]) {
 	}
 
 	// set the pins as output
-	if (mraa_gpio_dir(rPin, MRAA_GPIO_OUT) != MRAA_SUCCESS) {
+	struct gpio_out leds;
+	gpio_out_init(&leds);
+	int red = gpio_out_add(&leds, rPin);
+	if (red < 0) {
 		fprintf(stderr, "Cannot set D7 as output, exiting");
 		return MRAA_ERROR_UNSPECIFIED;
 	}
-	if (mraa_gpio_dir(yPin, MRAA_GPIO_OUT) != MRAA_SUCCESS) {
+	int yellow = gpio_out_add(&leds, yPin);
+	if (yellow < 0) {
 		fprintf(stderr, "Cannot set D8 as output, exiting");
 		return MRAA_ERROR_UNSPECIFIED;
 	}
 
-	// repeating loop
+	// repeating loop: each step sets both LEDs at once, writing only the one that changes
 	for (;;) {
-		mraa_gpio_write(rPin, 0);
-		mraa_gpio_write(yPin, 0);
+		gpio_out_stage(&leds, red, 0);
+		gpio_out_stage(&leds, yellow, 0);
+		gpio_out_commit(&leds);
 		sleep(1);
-		mraa_gpio_write(rPin, 1);
+		gpio_out_stage(&leds, red, 1);
+		gpio_out_stage(&leds, yellow, 0);
+		gpio_out_commit(&leds);
 		sleep(1);
-		mraa_gpio_write(rPin, 0);
-		mraa_gpio_write(yPin, 1);
+		gpio_out_stage(&leds, red, 0);
+		gpio_out_stage(&leds, yellow, 1);
+		gpio_out_commit(&leds);
 		sleep(1);
-		mraa_gpio_write(rPin, 1);
+		gpio_out_stage(&leds, red, 1);
+		gpio_out_stage(&leds, yellow, 1);
+		gpio_out_commit(&leds);
 		sleep(1);
 	}
 
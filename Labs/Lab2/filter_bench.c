@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "adc_filter.h"
+
+/*
+ * Benchmark of the accelerometer filters in adc_filter.c. Feeds blocks of
+ * synthetic 12-bit readings on every channel through each filter and reports
+ * how many samples per second it sustains on this CPU.
+ *
+ * Build on the board with: gcc -O2 filter_bench.c adc_filter.c -lmraa -o filter_bench
+ *
+ * @author Cameron Stanavige & Gene Osborne
+ * @version 10/19/2026
+ */
+
+// frames pushed through each filter
+#define FRAMES 2000000
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * Run one filter over FRAMES frames of the input blocks and print its rate.
+ *
+ * @param name   Label to print
+ * @param filter The configured filter
+ * @param in     One block of input frames, reused for every block
+ */
+static void bench(const char * name, struct adc_filter * filter, const adc_vec * in) {
+	static adc_vec out[ADC_SCAN_FRAMES];
+	double start = now(), secs;
+	long frames, outputs = 0;
+	float check = 0;
+
+	for (frames = 0; frames < FRAMES; frames += ADC_SCAN_FRAMES) {
+		int n = adc_filter_run(filter, in, ADC_SCAN_FRAMES, out);
+		if (n > 0)
+			check += out[n - 1][0];
+		outputs += n;
+	}
+	secs = now() - start;
+	printf("%-22s %7.2f Msamples/s  (%ld frames out, check %.1f)\n", name,
+			frames * ADC_MAX_CHANNELS / secs / 1e6, outputs, check);
+} // end bench
+
+int main(int argc, char* argv[]) {
+	static adc_vec in[ADC_SCAN_FRAMES];
+	struct adc_filter filter;
+	int i, c;
+
+	// level readings with a few counts of noise on every channel
+	srand(1);
+	for (i = 0; i < ADC_SCAN_FRAMES; i++)
+		for (c = 0; c < ADC_MAX_CHANNELS; c++)
+			in[i][c] = 1449 + rand() % 9 - 4;
+
+	printf("%d channels per frame, %d frames per filter\n", ADC_MAX_CHANNELS, FRAMES);
+
+	adc_filter_moving_average(&filter, 16);
+	bench("moving average (16)", &filter, in);
+	adc_filter_median(&filter, 5);
+	bench("median (5)", &filter, in);
+	adc_filter_median(&filter, 9);
+	bench("median (9)", &filter, in);
+	adc_filter_iir(&filter, 0.1f);
+	bench("IIR (alpha 0.1)", &filter, in);
+	adc_filter_cic(&filter, 16, 3);
+	bench("CIC (R 16, 3 stages)", &filter, in);
+
+	return 0;
+} // end main
@@ -1,7 +1,12 @@
 #include "mraa.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include "adc_oversample.h"
+#include "adc_lut.h"
+#include "adc_filter.h"
+#include "periodic.h"
+#include "level_state.h"
+#include "../Lab6/gpio_out.h"
 
 /*
  * CS 490 Lab-2 Part-3
@@ -11,6 +16,18 @@
  * a yellow LED when within 10% of being level and lighting a red LED
  * when within 1% of being level.
  *
+ * Both axes are sampled together in the background and time-aligned,
+ * so x and y always describe the same instant. They are oversampled
+ * for EXTRA_BITS more resolution than the 12-bit ADC near level, and
+ * smoothed (median to drop spikes, then a moving average). The
+ * combined x/y tilt is then classified with hysteresis and dwell
+ * times (see level_state.h), and the LEDs change only when the level
+ * state does, which is also printed.
+ *
+ * The LEDs are updated UPDATE_RATE times a second on a timer, and
+ * every REPORT_SECONDS the loop's rate, overruns and CPU use are
+ * printed so it can be checked alongside the other programs.
+ *
  * Code that is commented out in this file can be used for printing out
  * values for testing purposes.
  *
@@ -35,11 +52,38 @@ const float yZeroG = 1437;
 const float yPosG = 1720;
 const float yNegG = 1152;
 
-const float pi = 3.1415926535897;
+/*
+ * Level bands: yellow within 10 degrees, red within 1 degree. Each is
+ * entered below its first angle and left above its second, and only
+ * after the tilt has stayed there for the dwell times in milliseconds.
+ */
+const struct level_band levelBands[2] = {
+	{ 10, 11, 100, 100 },
+	{ 1, 1.3, 200, 100 }
+};
+#define YELLOW_STATE 1
+#define RED_STATE 2
+
+// frames per second from the accelerometer after oversampling, the bits
+// oversampling adds (sampling 4^EXTRA_BITS times faster), how many times
+// a second the LEDs are updated, and how often the load is reported
+#define OUTPUT_RATE 50
+#define EXTRA_BITS 2
+#if ADC_BASE_BITS + EXTRA_BITS > ADC_LUT_MAX_BITS
+#error "EXTRA_BITS gives readings too wide for the conversion tables"
+#endif
+#define UPDATE_RATE 50
+#define REPORT_SECONDS 10
+
+// PWM pin dithering the accelerometer inputs, or ADC_NO_DITHER
+#define DITHER_PIN ADC_NO_DITHER
+
+// smoothing windows in frames: 3 frames (60 ms) median, 4 frames (80 ms) average
+#define MEDIAN_FRAMES 3
+#define AVERAGE_FRAMES 4
 
 // function prototypes
-float normalize(unsigned int, float, float, float);
-int isLevel(float, int);
+unsigned int toCount(float, int);
 
 int main(int argc, char* argv[]) {
 	// set the pins to be used for the LEDs
@@ -51,88 +95,123 @@ int main(int argc, char* argv[]) {
 		return MRAA_ERROR_UNSPECIFIED;
 	}
 
-	// set the LED pins as output
-	if (mraa_gpio_dir(rPin, MRAA_GPIO_OUT) != MRAA_SUCCESS) {
+	// set the LED pins as output; they are only written when they change
+	struct gpio_out leds;
+	gpio_out_init(&leds);
+	int red = gpio_out_add(&leds, rPin);
+	if (red < 0) {
 		fprintf(stderr, "Cannot set D7 as output, exiting");
 		return MRAA_ERROR_UNSPECIFIED;
 	}
-	if (mraa_gpio_dir(yPin, MRAA_GPIO_OUT) != MRAA_SUCCESS) {
+	int yellow = gpio_out_add(&leds, yPin);
+	if (yellow < 0) {
 		fprintf(stderr, "Cannot set D8 as output, exiting");
 		return MRAA_ERROR_UNSPECIFIED;
 	}
+	// start outside every band with both LEDs off
+	gpio_out_write(&leds, red, 0);
+	gpio_out_write(&leds, yellow, 0);
+
+	// sample x (A0) and y (A1) of the accelerometer at 12 + EXTRA_BITS bits
+	static struct adc_oversampler sampler;
+	static struct adc_lut xLut, yLut;
+	static adc_vec frames[ADC_SCAN_FRAMES];
+	struct adc_filter median, average;
+	const unsigned int axes[2] = { 0, 1 };
+	const int bits = ADC_BASE_BITS + EXTRA_BITS;
+
+	if (adc_oversample_init(&sampler, axes, 2, OUTPUT_RATE, EXTRA_BITS, DITHER_PIN) < 0
+			|| adc_oversample_start(&sampler) < 0) {
+		fprintf(stderr, "Coulnd't initialize AIO, exiting");
+		return MRAA_ERROR_UNSPECIFIED;
+	}
 
-	// set pins to be used by accelerometer
-	mraa_aio_context xAxis = mraa_aio_init(0);
-	mraa_aio_context yAxis = mraa_aio_init(1);
-	// change the bit accuracy to 12 bits
-	mraa_aio_set_bit(xAxis, 12);
-	mraa_aio_set_bit(yAxis, 12);
+	// readings to g and tilt for every possible count
+	if (adc_lut_init(&xLut, bits, xZeroG, xPosG, xNegG) < 0
+			|| adc_lut_init(&yLut, bits, yZeroG, yPosG, yNegG) < 0) {
+		fprintf(stderr, "Couldn't build the conversion tables, exiting");
+		return MRAA_ERROR_UNSPECIFIED;
+	}
 
-	if (xAxis == NULL || yAxis == NULL) {
-		fprintf(stderr, "Coulnd't initialize AIO, exiting");
+	struct level_state level;
+	struct level_event event;
+	const char * stateNames[3] = { "not level", "within 10 degrees", "within 1 degree" };
+	if (level_state_init(&level, levelBands, 2) < 0) {
+		fprintf(stderr, "Level bands aren't nested, exiting");
+		return MRAA_ERROR_UNSPECIFIED;
+	}
+
+	adc_filter_median(&median, MEDIAN_FRAMES);
+	adc_filter_moving_average(&average, AVERAGE_FRAMES);
+
+	// run the loop at UPDATE_RATE
+	struct periodic loop;
+	struct periodic_stats stats;
+	if (periodic_init(&loop, UPDATE_RATE) < 0) {
+		fprintf(stderr, "Couldn't create the loop timer, exiting");
 		return MRAA_ERROR_UNSPECIFIED;
 	}
 
 	// variable declarations
 	unsigned int xValue, yValue;
-	float xNorm, yNorm;
-	//int xLevel, yLevel;
+	int n;
 
 	// loop to run program
 	for (;;) {
-		xValue = mraa_aio_read(xAxis);
-		yValue = mraa_aio_read(yAxis);
-
-		xNorm = normalize(xValue, xZeroG, xPosG, xNegG);
-		yNorm = normalize(yValue, yZeroG, yPosG, yNegG);
-
-		//xLevel = isLevel(xNorm, 10);
-		//yLevel = isLevel(yNorm, 10);
-
-		// light yellow LED when both x and y are within 10%
-		if (isLevel(xNorm, 10) == 0 && isLevel(yNorm, 10) == 0)
-			mraa_gpio_write(yPin, 1);
-		else
-			mraa_gpio_write(yPin, 0);
-		// light red LED when both x and y are within 1%
-		if (isLevel(xNorm, 1) == 0 && isLevel(yNorm, 1) == 0)
-			mraa_gpio_write(rPin, 1);
-		else
-			mraa_gpio_write(rPin, 0);
-
-		//printf("xAxis: %d, %f, %d yAxis: %d, %f, %d\n", xValue, xNorm, xLevel, yValue, yNorm, yLevel);
-		//usleep(200000);
+		periodic_wait(&loop);
+		if (loop.cycles >= REPORT_SECONDS * UPDATE_RATE) {
+			periodic_report(&loop, &stats);
+			printf("loop: %.1f Hz, %lu overruns, busy %.2f%%, worst %.0f us, cpu %.1f%%, %lu late samples, "
+					"%lu LED writes (%lu suppressed)\n", stats.rate_hz, stats.overruns, stats.busy * 100,
+					stats.worst_us, stats.cpu * 100, __atomic_load_n(&sampler.sampler.late, __ATOMIC_RELAXED),
+					leds.writes, leds.suppressed);
+		}
+
+		n = adc_oversample_read(&sampler, frames, ADC_SCAN_FRAMES);
+		if (n == 0)
+			continue;
+
+		// smooth both axes together, then use the newest frame
+		adc_filter_run(&median, frames, n, frames);
+		adc_filter_run(&average, frames, n, frames);
+		xValue = toCount(frames[n - 1][0], xLut.bits);
+		yValue = toCount(frames[n - 1][1], yLut.bits);
+
+		//printf("xAxis: %d, %f, %f yAxis: %d, %f, %f\n", xValue, xLut.g[xValue], xLut.tilt[xValue],
+		//		yValue, yLut.g[yValue], yLut.tilt[yValue]);
+
+		if (!level_state_update(&level, xLut.g[xValue], yLut.g[yValue], loop.woke_ns / 1000000,
+				&event))
+			continue;
+
+		// light yellow LED when within 10 degrees
+		gpio_out_stage(&leds, yellow, event.to >= YELLOW_STATE);
+		// light red LED when within 1 degree
+		gpio_out_stage(&leds, red, event.to >= RED_STATE);
+		gpio_out_commit(&leds);
+		printf("level: %s (%.2f degrees)\n", stateNames[event.to], event.tilt_deg);
 	}
-	mraa_aio_close(xAxis);
-	mraa_aio_close(yAxis);
+	periodic_close(&loop);
+	adc_oversample_close(&sampler);
+	gpio_out_close(&leds);
 
 	return 0;
 } // end main
 
 /*
- * Function to normalize the value being read in to +- 1g.
- *
- * @param reading The value that was read in from the accelerometer
- * @param middle The value to determine what is zero
- * @param max The value to determine what is 1g
- * @param min The value to determine what is -1g
- *
- * @return Floating point value normalized between -1 and 1
- */
-float normalize(unsigned int reading, float middle, float max, float min) {
-	return reading > middle ? (reading - middle) / (max - middle) :	(reading - middle) / (middle - min);
-} // end normalize
-
-/*
- * Function to determine if the normalized value is within the specified
- * degree
+ * Function to round a filtered reading back to a count that can index
+ * the conversion tables
  *
- * @param norm The normalized floating point value to be determined if it
- * 				if it is within the specified degree of tolerance
- * @param degree The degree of tolerance for norm to be within (1-90 degrees)
+ * @param value The filtered reading
+ * @param bits The resolution of the reading
  *
- * @return 0 if is level; 1 if not level
+ * @return The nearest count between 0 and 2^bits - 1
  */
-int isLevel(float norm, int degree) {
-	return fabsf(asin(norm)) * (180/pi) < degree ? 0 : 1;
-} //end isLevel
+unsigned int toCount(float value, int bits) {
+	const float top = (1 << bits) - 1;
+	if (value <= 0)
+		return 0;
+	if (value >= top)
+		return top;
+	return (unsigned int) (value + 0.5f);
+} // end toCount
@@ -0,0 +1,69 @@
+#include <math.h>
+#include "level_state.h"
+
+static const float pi = 3.1415926535897;
+
+static float sin2(float degrees) {
+	float s = sinf(degrees * pi / 180);
+	return s * s;
+}
+
+int level_state_init(struct level_state * level, const struct level_band * bands, int count) {
+	int b;
+
+	if (count < 1 || count > LEVEL_STATE_MAX_BANDS)
+		return -1;
+	for (b = 0; b < count; b++) {
+		if (bands[b].exit_deg < bands[b].enter_deg)
+			return -1;
+		if (b > 0 && bands[b].exit_deg > bands[b - 1].enter_deg)
+			return -1; // leaving a band must not also leave the wider one
+		level->band[b] = bands[b];
+		level->enter_r2[b] = sin2(bands[b].enter_deg);
+		level->exit_r2[b] = sin2(bands[b].exit_deg);
+	}
+	level->bands = count;
+	level->state = LEVEL_STATE_NONE;
+	level->pending = LEVEL_STATE_NONE;
+	level->pending_ms = 0;
+	level->events = 0;
+	return 0;
+}
+
+int level_state_update(struct level_state * level, float gx, float gy, uint64_t now_ms,
+		struct level_event * event) {
+	float r2 = gx * gx + gy * gy;
+	int target = LEVEL_STATE_NONE, b;
+	unsigned int dwell;
+
+	// innermost band the tilt is in: bands already held use the wider exit angle
+	for (b = 0; b < level->bands; b++) {
+		if (r2 >= (b < level->state ? level->exit_r2[b] : level->enter_r2[b]))
+			break;
+		target = b + 1;
+	}
+
+	if (target == level->state) {
+		level->pending = level->state;
+		return 0;
+	}
+	if (target != level->pending) {
+		level->pending = target;
+		level->pending_ms = now_ms;
+	}
+
+	// going in waits for the enter dwell of the band entered, going out for the exit
+	// dwell of the band left
+	dwell = target > level->state ? level->band[target - 1].enter_dwell_ms
+			: level->band[level->state - 1].exit_dwell_ms;
+	if (now_ms - level->pending_ms < dwell)
+		return 0;
+
+	event->from = level->state;
+	event->to = target;
+	event->tilt_deg = asinf(r2 < 1 ? sqrtf(r2) : 1) * (180 / pi);
+	event->t_ms = now_ms;
+	level->state = target;
+	level->events++;
+	return 1;
+}
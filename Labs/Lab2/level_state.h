@@ -0,0 +1,116 @@
+/**
+ * @file
+ * @brief Level classifier for the combined x/y tilt of the accelerometer. The tilt
+ * is sorted into nested bands (e.g. within 10 degrees, within 1 degree) with
+ * hysteresis: a band is entered below its enter angle but only left above its wider
+ * exit angle, and a change has to hold for the band's dwell time before it is
+ * accepted. The classifier reports only state changes, so noise around a boundary
+ * doesn't produce a stream of flips.
+ *
+ * Thresholds are kept as sin^2 of their angles and compared with gx^2 + gy^2, so
+ * classifying a frame takes no trigonometry.
+ *
+ * e.g.: struct level_state level;
+ * 		 struct level_event event;
+ * 		 level_state_init(&level, bands, 2);
+ * 		 if (level_state_update(&level, gx, gy, now_ms, &event))
+ * 		 	... event.to is the new band ...
+ */
+
+#ifndef LEVEL_STATE_H_
+#define LEVEL_STATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Most bands one classifier can hold
+ */
+#define LEVEL_STATE_MAX_BANDS	4
+
+/**
+ * State when the tilt is outside every band
+ */
+#define LEVEL_STATE_NONE		0
+
+/**
+ * One band, from widest to narrowest. Band n is state n + 1.
+ * 		enter_deg		Tilt below which the band is entered
+ * 		exit_deg		Tilt above which the band is left (at least enter_deg)
+ * 		enter_dwell_ms	Time the tilt must stay inside before the band is entered
+ * 		exit_dwell_ms	Time the tilt must stay outside before the band is left
+ */
+struct level_band {
+	float enter_deg;
+	float exit_deg;
+	unsigned int enter_dwell_ms;
+	unsigned int exit_dwell_ms;
+};
+
+/**
+ * A change of state.
+ * 		from, to	Old and new state (LEVEL_STATE_NONE or band number + 1)
+ * 		tilt_deg	Combined tilt of the frame that completed the change
+ * 		t_ms		When the change was accepted
+ */
+struct level_event {
+	int from;
+	int to;
+	float tilt_deg;
+	uint64_t t_ms;
+};
+
+/**
+ * State of a classifier. Treat the members as private.
+ * 		bands			Number of bands
+ * 		band			Configuration of each band
+ * 		enter_r2		sin^2 of each band's enter angle
+ * 		exit_r2			sin^2 of each band's exit angle
+ * 		state			Accepted state
+ * 		pending			State the tilt currently points at
+ * 		pending_ms		When the tilt started pointing at pending
+ * 		events			State changes reported
+ */
+struct level_state {
+	int bands;
+	struct level_band band[LEVEL_STATE_MAX_BANDS];
+	float enter_r2[LEVEL_STATE_MAX_BANDS];
+	float exit_r2[LEVEL_STATE_MAX_BANDS];
+	int state;
+	int pending;
+	uint64_t pending_ms;
+	unsigned long events;
+};
+
+/**
+ * Set up a classifier starting outside every band.
+ *
+ * @param level_state The classifier to initialize
+ * @param level_band* The bands, widest first
+ * @param int         Number of bands (at most LEVEL_STATE_MAX_BANDS)
+ *
+ * @return 0 on success, -1 if the bands aren't nested or an exit angle is below its
+ * enter angle
+ */
+int level_state_init(struct level_state*, const struct level_band*, int);
+
+/**
+ * Classify one frame.
+ *
+ * @param level_state The classifier
+ * @param float       x acceleration in g
+ * @param float       y acceleration in g
+ * @param uint64_t    Time of the frame in milliseconds
+ * @param level_event Filled in when the state changes
+ *
+ * @return 1 if the state changed, 0 if not
+ */
+int level_state_update(struct level_state*, float, float, uint64_t, struct level_event*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LEVEL_STATE_H_ */
@@ -0,0 +1,87 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "periodic.h"
+
+static uint64_t clock_ns(clockid_t clock) {
+	struct timespec t;
+	clock_gettime(clock, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+int periodic_init(struct periodic * p, unsigned int rate_hz) {
+	struct itimerspec spec;
+
+	if (rate_hz == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(p, 0, sizeof(*p));
+	p->period_ns = 1000000000ULL / rate_hz;
+	p->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (p->fd < 0)
+		return -1;
+
+	spec.it_interval.tv_sec = p->period_ns / 1000000000ULL;
+	spec.it_interval.tv_nsec = p->period_ns % 1000000000ULL;
+	spec.it_value = spec.it_interval;
+	if (timerfd_settime(p->fd, 0, &spec, NULL) < 0) {
+		close(p->fd);
+		p->fd = -1;
+		return -1;
+	}
+	p->start_ns = clock_ns(CLOCK_MONOTONIC);
+	p->start_cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+	return 0;
+}
+
+int periodic_wait(struct periodic * p) {
+	uint64_t expirations, now = clock_ns(CLOCK_MONOTONIC);
+	ssize_t n;
+
+	if (p->woke_ns != 0) {
+		uint64_t pass = now - p->woke_ns;
+		p->busy_ns += pass;
+		if (pass > p->worst_ns)
+			p->worst_ns = pass;
+	}
+
+	// the count of expirations since the last read: more than one means missed periods
+	do
+		n = read(p->fd, &expirations, sizeof(expirations));
+	while (n < 0 && errno == EINTR);
+	if (n != sizeof(expirations))
+		return -1;
+
+	p->woke_ns = clock_ns(CLOCK_MONOTONIC);
+	p->cycles++;
+	p->overruns += expirations - 1;
+	return (int) (expirations - 1);
+}
+
+void periodic_report(struct periodic * p, struct periodic_stats * stats) {
+	uint64_t now = clock_ns(CLOCK_MONOTONIC), cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+	float elapsed = (now - p->start_ns) / 1e9f;
+
+	stats->cycles = p->cycles;
+	stats->overruns = p->overruns;
+	stats->rate_hz = elapsed > 0 ? p->cycles / elapsed : 0;
+	stats->busy = elapsed > 0 ? p->busy_ns / 1e9f / elapsed : 0;
+	stats->worst_us = p->worst_ns / 1e3f;
+	stats->cpu = elapsed > 0 ? (cpu - p->start_cpu_ns) / 1e9f / elapsed : 0;
+
+	p->start_ns = now;
+	p->start_cpu_ns = cpu;
+	p->cycles = 0;
+	p->overruns = 0;
+	p->busy_ns = 0;
+	p->worst_ns = 0;
+}
+
+void periodic_close(struct periodic * p) {
+	if (p->fd >= 0)
+		close(p->fd);
+	p->fd = -1;
+}
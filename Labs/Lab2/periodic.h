@@ -0,0 +1,106 @@
+/**
+ * @file
+ * @brief Fixed-rate loop timing on a timerfd. The timer expires on its own schedule
+ * no matter how long each pass of the loop takes, so the rate doesn't drift, and a
+ * pass that runs past the next expiry is counted as an overrun. The time spent
+ * running between waits and the process's CPU time are tracked so the load the loop
+ * puts on the board can be reported.
+ *
+ * e.g.: struct periodic loop;
+ * 		 periodic_init(&loop, 50);
+ * 		 for (;;) {
+ * 		 	periodic_wait(&loop);
+ * 		 	... sample, filter, decide, output ...
+ * 		 }
+ */
+
+#ifndef PERIODIC_H_
+#define PERIODIC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * State of a periodic loop. Treat the members as private.
+ * 		fd				timerfd expiring once per period
+ * 		period_ns		Length of one period
+ * 		start_ns		When the loop started
+ * 		start_cpu_ns	Process CPU time when the loop started
+ * 		woke_ns			When the current pass began (0 before the first)
+ * 		cycles			Passes run
+ * 		overruns		Periods missed because a pass ran too long
+ * 		busy_ns			Total time spent in passes
+ * 		worst_ns		Longest pass
+ */
+struct periodic {
+	int fd;
+	uint64_t period_ns;
+	uint64_t start_ns;
+	uint64_t start_cpu_ns;
+	uint64_t woke_ns;
+	unsigned long cycles;
+	unsigned long overruns;
+	uint64_t busy_ns;
+	uint64_t worst_ns;
+};
+
+/**
+ * Loop statistics since periodic_init() or the last periodic_report().
+ * 		rate_hz		Passes per second achieved
+ * 		cycles		Passes run
+ * 		overruns	Periods missed
+ * 		busy		Fraction of the time spent in passes (duty of the loop)
+ * 		worst_us	Longest pass in microseconds
+ * 		cpu			CPU time of the whole process (all threads) per second of
+ * 					wall time; 1.0 is one core fully used
+ */
+struct periodic_stats {
+	float rate_hz;
+	unsigned long cycles;
+	unsigned long overruns;
+	float busy;
+	float worst_us;
+	float cpu;
+};
+
+/**
+ * Start a timer expiring at the given rate.
+ *
+ * @param periodic     The loop to initialize
+ * @param unsigned int Passes per second
+ *
+ * @return 0 on success, -1 with errno set on failure
+ */
+int periodic_init(struct periodic*, unsigned int);
+
+/**
+ * End the current pass and sleep until the timer next expires.
+ *
+ * @param periodic The loop to wait on
+ *
+ * @return Periods missed since the last wait (0 when on time), or -1 on failure
+ */
+int periodic_wait(struct periodic*);
+
+/**
+ * Get the loop statistics and start counting afresh.
+ *
+ * @param periodic       The loop to report on
+ * @param periodic_stats Filled in with the statistics
+ */
+void periodic_report(struct periodic*, struct periodic_stats*);
+
+/**
+ * Stop the timer.
+ *
+ * @param periodic The loop to close
+ */
+void periodic_close(struct periodic*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PERIODIC_H_ */
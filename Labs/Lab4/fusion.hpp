@@ -0,0 +1,350 @@
+/**
+ * @file
+ * @brief Orientation of the LSM9DS0 from its accelerometer, gyro and magnetometer,
+ * using Mahony's complementary filter. The gyro is integrated on every sample, and
+ * the drift is steered out proportionally (kp) and integrally (ki) by the error
+ * between where gravity and magnetic north should be and where the accelerometer and
+ * magnetometer see them.
+ *
+ * The filter is a template on its scalar type: float, or Fixed<F> (a 32-bit
+ * fixed-point number with F fraction bits) for a build without floating point in the
+ * update. Either way the result is handed back as floats.
+ *
+ * Fusion feeds the filter from the sensor's samples, one update per gyro sample, so
+ * the orientation comes out at the gyro's full output data rate.
+ *
+ * e.g.: lsm9ds0::Fusion<float> fusion(lsm9ds0::gyroSensitivity(imu.cached(reg::CTRL_REG4_G)));
+ * 		 lsm9ds0::Attitude attitude;
+ * 		 fusion.setAccel(accel.v);
+ * 		 fusion.setMag(mag.v);
+ * 		 if (fusion.update(gyro, attitude))
+ * 		 	... attitude.roll, attitude.pitch, attitude.yaw ...
+ */
+
+#ifndef FUSION_HPP_
+#define FUSION_HPP_
+
+#include <stdint.h>
+#include <math.h>
+#include "lsm9ds0.hpp"
+
+namespace lsm9ds0 {
+
+/**
+ * A signed 32-bit fixed-point number with F fraction bits, so it holds
+ * +-2^(31-F) in steps of 2^-F. Fixed<24> covers +-128, enough for unit vectors and
+ * the gyro's 2000 dps range in rad/s.
+ */
+template <int F>
+class Fixed {
+public:
+	Fixed() : raw(0) {}
+
+	explicit Fixed(float v) : raw((int32_t) lrintf(v * (float) (1L << F))) {}
+
+	/**
+	 * A fixed-point number from its raw bits
+	 */
+	static Fixed fromRaw(int32_t bits) {
+		Fixed f;
+		f.raw = bits;
+		return f;
+	}
+
+	int32_t bits() const {
+		return raw;
+	}
+
+	Fixed operator+(Fixed b) const {
+		return fromRaw(raw + b.raw);
+	}
+	Fixed operator-(Fixed b) const {
+		return fromRaw(raw - b.raw);
+	}
+	Fixed operator-() const {
+		return fromRaw(-raw);
+	}
+	Fixed operator*(Fixed b) const {
+		return fromRaw((int32_t) (((int64_t) raw * b.raw) >> F));
+	}
+	Fixed operator/(Fixed b) const {
+		return fromRaw((int32_t) (((int64_t) raw << F) / b.raw));
+	}
+	Fixed& operator+=(Fixed b) {
+		raw += b.raw;
+		return *this;
+	}
+	Fixed& operator-=(Fixed b) {
+		raw -= b.raw;
+		return *this;
+	}
+	Fixed& operator*=(Fixed b) {
+		return *this = *this * b;
+	}
+	bool operator==(Fixed b) const {
+		return raw == b.raw;
+	}
+	bool operator>(Fixed b) const {
+		return raw > b.raw;
+	}
+
+private:
+	int32_t raw;
+};
+
+/**
+ * Operations the filter needs on its scalar type, for float and for Fixed:
+ * 		invSqrt		1 / sqrt(x), for x > 0
+ * 		toFloat		The value as a float
+ * 		fromCount	A sensor count as a fraction of full scale (count / 32768)
+ */
+inline float invSqrt(float x) {
+	return 1.0f / sqrtf(x);
+}
+
+inline float toFloat(float x) {
+	return x;
+}
+
+inline float fromCount(int16_t count, float) {
+	return count * (1.0f / 32768);
+}
+
+template <int F>
+Fixed<F> invSqrt(Fixed<F> x) {
+	// sqrt(x) has the raw value isqrt(raw << F); divide one (raw 1 << 2F) by it
+	uint64_t n = (uint64_t) x.bits() << F, root = 0, bit = 1ULL << 62;
+	if (x.bits() <= 0)
+		return Fixed<F>::fromRaw(INT32_MAX);
+	while (bit > n)
+		bit >>= 2;
+	while (bit != 0) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	// tiny inputs have an inverse root beyond the format: saturate like zero does
+	uint64_t inv = (1ULL << (2 * F)) / root;
+	return Fixed<F>::fromRaw(inv > INT32_MAX ? INT32_MAX : (int32_t) inv);
+}
+
+template <int F>
+float toFloat(Fixed<F> x) {
+	return x.bits() * (1.0f / (1L << F));
+}
+
+template <int F>
+Fixed<F> fromCount(int16_t count, Fixed<F>) {
+	return Fixed<F>::fromRaw((int32_t) count * (1L << (F - 15)));
+}
+
+/**
+ * Mahony's filter. The gyro is in rad/s; the accelerometer and magnetometer only
+ * need the right direction, in any units that don't overflow the scalar.
+ */
+template <typename T>
+class Mahony {
+public:
+	/**
+	 * @param kp Proportional gain on the accelerometer/magnetometer error
+	 * @param ki Integral gain (0 to turn off gyro bias estimation)
+	 */
+	Mahony(float kp = 1.0f, float ki = 0.0f) :
+			twoKp(2 * kp), twoKi(2 * ki), half(0.5f) {
+		q[0] = T(1.0f);
+		q[1] = q[2] = q[3] = T();
+		bias[0] = bias[1] = bias[2] = T();
+	}
+
+	/**
+	 * Advances the orientation by one gyro sample, corrected towards the accelerometer
+	 * and magnetometer. A zero magnetometer reading leaves the heading to the gyro.
+	 *
+	 * @param g Rotation rate about X, Y and Z in rad/s
+	 * @param a Acceleration
+	 * @param m Magnetic field
+	 * @param dt Time since the previous update in seconds
+	 */
+	void update(const T g[3], const T a[3], const T m[3], T dt) {
+		T gx = g[0], gy = g[1], gz = g[2];
+		T ex = T(), ey = T(), ez = T();
+		T n, ax, ay, az;
+
+		n = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+		if (n > T()) {
+			// direction of gravity the orientation predicts, against the measured one
+			n = invSqrt(n);
+			ax = a[0] * n;
+			ay = a[1] * n;
+			az = a[2] * n;
+			T vx = q[1] * q[3] - q[0] * q[2];
+			T vy = q[0] * q[1] + q[2] * q[3];
+			T vz = q[0] * q[0] - half + q[3] * q[3];
+			ex = ay * vz - az * vy;
+			ey = az * vx - ax * vz;
+			ez = ax * vy - ay * vx;
+
+			n = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+			if (n > T()) {
+				// earth's field in the body frame, reduced to its north and down parts
+				n = invSqrt(n);
+				T mx = m[0] * n, my = m[1] * n, mz = m[2] * n;
+				T q0q1 = q[0] * q[1], q0q2 = q[0] * q[2], q0q3 = q[0] * q[3];
+				T q1q1 = q[1] * q[1], q1q2 = q[1] * q[2], q1q3 = q[1] * q[3];
+				T q2q2 = q[2] * q[2], q2q3 = q[2] * q[3], q3q3 = q[3] * q[3];
+				T hx = mx * (half - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2);
+				T hy = mx * (q1q2 + q0q3) + my * (half - q1q1 - q3q3) + mz * (q2q3 - q0q1);
+				T bz = mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (half - q1q1 - q2q2);
+				T bx = hx * hx + hy * hy;
+				bx = bx > T() ? bx * invSqrt(bx) : T();
+				T wx = bx * (half - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+				T wy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+				T wz = bx * (q0q2 + q1q3) + bz * (half - q1q1 - q2q2);
+				ex += my * wz - mz * wy;
+				ey += mz * wx - mx * wz;
+				ez += mx * wy - my * wx;
+			}
+		}
+
+		if (twoKi > T()) {
+			bias[0] += twoKi * ex * dt;
+			bias[1] += twoKi * ey * dt;
+			bias[2] += twoKi * ez * dt;
+			gx += bias[0];
+			gy += bias[1];
+			gz += bias[2];
+		}
+		gx += twoKp * ex;
+		gy += twoKp * ey;
+		gz += twoKp * ez;
+
+		// integrate the rate of change of the quaternion
+		T hdt = half * dt;
+		gx *= hdt;
+		gy *= hdt;
+		gz *= hdt;
+		T qa = q[0], qb = q[1], qc = q[2];
+		q[0] += -qb * gx - qc * gy - q[3] * gz;
+		q[1] += qa * gx + qc * gz - q[3] * gy;
+		q[2] += qa * gy - qb * gz + q[3] * gx;
+		q[3] += qa * gz + qb * gy - qc * gx;
+
+		n = invSqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (int i = 0; i < 4; i++)
+			q[i] *= n;
+	}
+
+	/**
+	 * Component i of the orientation quaternion (w, x, y, z)
+	 */
+	float quaternion(int i) const {
+		return toFloat(q[i]);
+	}
+
+private:
+	T twoKp, twoKi, half;
+	T q[4];
+	T bias[3];
+};
+
+/**
+ * An orientation and the time of the gyro sample it was updated with.
+ * 		q					Quaternion (w, x, y, z) from the sensor frame to the earth frame
+ * 		roll, pitch, yaw	The same orientation as Euler angles in degrees
+ */
+struct Attitude {
+	uint64_t tNs;
+	float q[4];
+	float roll, pitch, yaw;
+};
+
+/**
+ * Runs a Mahony filter on the sensor's samples: the latest accelerometer and
+ * magnetometer readings are held, and each gyro sample advances the filter by the
+ * time since the previous one.
+ */
+template <typename T>
+class Fusion {
+public:
+	/**
+	 * @param dpsPerCount Gyro sensitivity (see gyroSensitivity())
+	 * @param kp Proportional gain
+	 * @param ki Integral gain
+	 */
+	Fusion(float dpsPerCount, float kp = 1.0f, float ki = 0.0f) :
+			filter(kp, ki), fullScale(32768 * dpsPerCount * (float) M_PI / 180), lastNs(0) {
+		for (int i = 0; i < 3; i++)
+			a[i] = m[i] = T();
+	}
+
+	/**
+	 * Holds the latest accelerometer reading
+	 */
+	void setAccel(const Vector& v) {
+		a[0] = fromCount(v.x, T());
+		a[1] = fromCount(v.y, T());
+		a[2] = fromCount(v.z, T());
+	}
+
+	/**
+	 * Holds the latest magnetometer reading
+	 */
+	void setMag(const Vector& v) {
+		m[0] = fromCount(v.x, T());
+		m[1] = fromCount(v.y, T());
+		m[2] = fromCount(v.z, T());
+	}
+
+	/**
+	 * Advances the orientation to the time of a gyro sample.
+	 *
+	 * @param gyro The gyro sample
+	 * @param out Filled in with the new orientation
+	 *
+	 * @return false for the first sample (or after a gap of over a second), which
+	 * 		   only sets the time
+	 */
+	bool update(const Sample& gyro, Attitude& out) {
+		uint64_t dtNs = gyro.tNs - lastNs;
+		bool first = lastNs == 0 || gyro.tNs <= lastNs || dtNs > 1000000000ULL;
+		lastNs = gyro.tNs;
+		if (first)
+			return false;
+
+		T g[3] = {
+			fromCount(gyro.v.x, T()) * fullScale,
+			fromCount(gyro.v.y, T()) * fullScale,
+			fromCount(gyro.v.z, T()) * fullScale
+		};
+		filter.update(g, a, m, T(dtNs * 1e-9f));
+
+		out.tNs = gyro.tNs;
+		for (int i = 0; i < 4; i++)
+			out.q[i] = filter.quaternion(i);
+		toEuler(out);
+		return true;
+	}
+
+private:
+	static void toEuler(Attitude& out) {
+		const float* q = out.q;
+		const float deg = 180 / (float) M_PI;
+		float s = 2 * (q[0] * q[2] - q[3] * q[1]);
+		out.roll = atan2f(2 * (q[0] * q[1] + q[2] * q[3]), 1 - 2 * (q[1] * q[1] + q[2] * q[2])) * deg;
+		out.pitch = (s >= 1 ? 90 : s <= -1 ? -90 : asinf(s) * deg);
+		out.yaw = atan2f(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3])) * deg;
+	}
+
+	Mahony<T> filter;
+	T fullScale;
+	T a[3], m[3];
+	uint64_t lastNs;
+};
+
+} // namespace lsm9ds0
+
+#endif /* FUSION_HPP_ */
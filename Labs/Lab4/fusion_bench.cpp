@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "fusion.hpp"
+
+/*
+ * Benchmark of the orientation filter in fusion.hpp. Pins itself to each CPU in
+ * turn and feeds the float and fixed-point filters a synthetic stream of samples
+ * from a sensor lying still, tilted 30 degrees about X, then reports how many updates
+ * per second one core sustains and the orientation the filter settled on.
+ *
+ * Build on the board with: g++ -O2 -std=c++11 fusion_bench.cpp lsm9ds0.cpp imu_bus.cpp i2c_manager.cpp -lmraa -lpthread -o fusion_bench
+ *
+ * @author Cameron Stanavige
+ * @version 10/19/2026
+ */
+
+// updates run through each filter, and gyro samples per second of the synthetic stream
+#define UPDATES 2000000
+#define SAMPLE_RATE 760
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * Run one filter over UPDATES samples and print its rate.
+ *
+ * @param name  Label to print
+ * @param accel Accelerometer reading held for every update
+ * @param mag   Magnetometer reading held for every update
+ */
+template <typename T>
+static void bench(const char * name, const lsm9ds0::Vector& accel, const lsm9ds0::Vector& mag) {
+	lsm9ds0::Fusion<T> fusion(lsm9ds0::gyroSensitivity(0x00), 2.0f);
+	lsm9ds0::Attitude attitude = lsm9ds0::Attitude();
+	lsm9ds0::Sample gyro;
+	double start, secs;
+	long i;
+
+	fusion.setAccel(accel);
+	fusion.setMag(mag);
+	gyro.tNs = 1;
+	start = now();
+	for (i = 0; i < UPDATES; i++) {
+		// a few counts of gyro noise
+		gyro.v.x = (int16_t) ((i * 7) % 9 - 4);
+		gyro.v.y = (int16_t) ((i * 5) % 7 - 3);
+		gyro.v.z = (int16_t) ((i * 3) % 5 - 2);
+		gyro.tNs += 1000000000ULL / SAMPLE_RATE;
+		fusion.update(gyro, attitude);
+	}
+	secs = now() - start;
+	printf("  %-14s %7.3f Mupdates/s  (roll %.2f pitch %.2f yaw %.2f)\n", name,
+			UPDATES / secs / 1e6, attitude.roll, attitude.pitch, attitude.yaw);
+} // end bench
+
+int main(int argc, char* argv[]) {
+	// 1 g tilted 30 degrees about X, and a field pointing north and down seen in the
+	// same tilted frame (4000 north, 3000 down)
+	const lsm9ds0::Vector accel = { 0, 8192, 14189 };
+	const lsm9ds0::Vector mag = { 4000, -1500, -2598 };
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+
+	printf("%d updates per filter, %ld cores\n", UPDATES, cpus);
+	for (int cpu = 0; cpu < cpus; cpu++) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			continue;
+		printf("core %d\n", cpu);
+		bench<float>("float", accel, mag);
+		bench<lsm9ds0::Fixed<24> >("fixed (Q7.24)", accel, mag);
+	}
+
+	return 0;
+} // end main
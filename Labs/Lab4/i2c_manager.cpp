@@ -0,0 +1,269 @@
+#include <string.h>
+#include <time.h>
+#include "i2c_manager.hpp"
+
+namespace lsm9ds0 {
+
+// sub-address bit for auto-increment: only reads that ask for it are joined into a
+// longer burst
+static const uint8_t AUTO_INCREMENT_BIT = 0x80;
+
+// most reads served by one burst
+static const int MAX_RIDERS = 8;
+
+static thread_local Priority threadPriority = PRIORITY_NORMAL;
+
+static uint64_t nowNs() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+PriorityScope::PriorityScope(Priority priority) : saved(threadPriority) {
+	threadPriority = priority;
+}
+
+PriorityScope::~PriorityScope() {
+	threadPriority = saved;
+}
+
+I2cManager::I2cManager(int bus) : i2c(new MraaI2c(bus)), owned(true) {
+	start();
+}
+
+I2cManager::I2cManager(I2cTransport& transport) : i2c(&transport), owned(false) {
+	start();
+}
+
+void I2cManager::start() {
+	current = -1;
+	stopping = false;
+	sinceNs = nowNs();
+	busyNs = 0;
+	transactions = bytes = requests = coalesced = switches = 0;
+	memset(worstWaitNs, 0, sizeof(worstWaitNs));
+	pthread_create(&thread, NULL, &run, this);
+}
+
+I2cManager::~I2cManager() {
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		stopping = true;
+	}
+	queued.notify_all();
+	pthread_join(thread, NULL);
+	if (owned)
+		delete i2c;
+}
+
+int I2cManager::read(uint8_t addr, uint8_t reg, uint8_t* buf, int len, bool mergeable) {
+	Request r = Request();
+	r.addr = addr;
+	r.reg = reg;
+	r.buf = buf;
+	r.len = len;
+	r.mergeable = mergeable;
+	return submit(r);
+}
+
+bool I2cManager::write(uint8_t addr, uint8_t reg, uint8_t value) {
+	Request r = Request();
+	r.write = true;
+	r.addr = addr;
+	r.reg = reg;
+	r.value = value;
+	return submit(r) == 0;
+}
+
+void I2cManager::splitAfter(uint8_t addr, uint8_t reg) {
+	std::lock_guard<std::mutex> hold(lock);
+	boundaries.push_back((uint16_t) (addr << 8 | (reg & ~AUTO_INCREMENT_BIT)));
+}
+
+int I2cManager::submit(Request& r) {
+	std::unique_lock<std::mutex> hold(lock);
+	if (stopping)
+		return -1;
+	r.priority = threadPriority;
+	r.queuedNs = nowNs();
+	queue[r.priority].push_back(&r);
+	queued.notify_one();
+	finished.wait(hold, [&r] { return r.done; });
+	return r.result;
+}
+
+// called without the lock; switched says whether the address changed, for the stats
+bool I2cManager::select(uint8_t addr, bool& switched) {
+	switched = false;
+	if (current == addr)
+		return true;
+	if (!i2c->address(addr)) {
+		current = -1;
+		return false;
+	}
+	current = addr;
+	switched = true;
+	return true;
+}
+
+// whether registers first to end - 1 of a device run across a boundary
+bool I2cManager::splits(uint8_t addr, int first, int end) const {
+	for (size_t i = 0; i < boundaries.size(); i++) {
+		int reg = boundaries[i] & 0xFF;
+		if ((boundaries[i] >> 8) == addr && reg >= first && reg < end - 1)
+			return true;
+	}
+	return false;
+}
+
+int I2cManager::gather(Request* head, Request** riders, int& first, int& len) {
+	int n = 0, end;
+	bool grown = true;
+
+	first = head->reg;
+	len = head->len;
+	if (head->write || !head->mergeable || head->len > MAX_BURST)
+		return 0;
+
+	// take every queued mergeable read of the same device that overlaps or touches
+	// the burst, until it stops growing; without auto-increment only identical reads
+	// can share
+	while (grown && n < MAX_RIDERS) {
+		grown = false;
+		for (int p = 0; p < PRIORITIES; p++) {
+			for (std::deque<Request*>::iterator it = queue[p].begin(); it != queue[p].end()
+					&& n < MAX_RIDERS;) {
+				Request* r = *it;
+				bool join;
+				if (r->write || !r->mergeable || r->addr != head->addr) {
+					++it;
+					continue;
+				}
+				if (!(head->reg & AUTO_INCREMENT_BIT) || !(r->reg & AUTO_INCREMENT_BIT)) {
+					join = r->reg == head->reg && r->len == head->len;
+				} else {
+					int lo = first < r->reg ? first : r->reg;
+					end = first + len > r->reg + r->len ? first + len : r->reg + r->len;
+					join = r->reg <= first + len && r->reg + r->len >= first
+							&& end - lo <= MAX_BURST
+							&& !splits(head->addr, lo & ~AUTO_INCREMENT_BIT,
+									(lo & ~AUTO_INCREMENT_BIT) + end - lo);
+					if (join) {
+						grown |= lo != first || end - lo != len;
+						first = lo;
+						len = end - lo;
+					}
+				}
+				if (join) {
+					riders[n++] = r;
+					it = queue[p].erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+	}
+	return n;
+}
+
+void I2cManager::execute(Request* head) {
+	Request* riders[MAX_RIDERS];
+	uint8_t buf[MAX_BURST];
+	uint64_t start, end;
+	int first, len, n, result;
+	bool switched;
+
+	// called with the lock held; it is released for the transaction itself
+	n = gather(head, riders, first, len);
+	start = nowNs();
+	for (int i = -1; i < n; i++) {
+		Request* r = i < 0 ? head : riders[i];
+		uint64_t wait = start - r->queuedNs;
+		if (wait > worstWaitNs[r->priority])
+			worstWaitNs[r->priority] = wait;
+	}
+	lock.unlock();
+
+	if (!select(head->addr, switched))
+		result = -1;
+	else if (head->write)
+		result = i2c->writeReg(head->reg, head->value) ? 0 : -1;
+	else if (n == 0)
+		result = i2c->readBytesReg(head->reg, head->buf, head->len); // straight into the caller's buffer
+	else
+		result = i2c->readBytesReg(first, buf, len);
+	end = nowNs();
+
+	lock.lock();
+	busyNs += end - start;
+	transactions++;
+	if (switched)
+		switches++;
+	bytes += head->write ? 1 : (n == 0 ? head->len : len);
+	requests += n + 1;
+	coalesced += n;
+	if (n == 0) {
+		head->result = result;
+	} else {
+		for (int i = -1; i < n; i++) {
+			Request* r = i < 0 ? head : riders[i];
+			int offset = (r->reg & ~AUTO_INCREMENT_BIT) - (first & ~AUTO_INCREMENT_BIT);
+			if (result == len) {
+				memcpy(r->buf, buf + offset, r->len);
+				r->result = r->len;
+			} else {
+				r->result = -1;
+			}
+		}
+	}
+	head->done = true;
+	for (int i = 0; i < n; i++)
+		riders[i]->done = true;
+}
+
+void* I2cManager::run(void* self) {
+	I2cManager* m = (I2cManager*) self;
+	std::unique_lock<std::mutex> hold(m->lock);
+
+	for (;;) {
+		Request* head = NULL;
+		for (int p = 0; p < PRIORITIES && head == NULL; p++) {
+			if (!m->queue[p].empty()) {
+				head = m->queue[p].front();
+				m->queue[p].pop_front();
+			}
+		}
+		if (head == NULL) {
+			if (m->stopping)
+				break;
+			m->queued.wait(hold);
+			continue;
+		}
+		m->execute(head);
+		m->finished.notify_all();
+	}
+	return NULL;
+}
+
+void I2cManager::stats(I2cStats& out, bool reset) {
+	std::lock_guard<std::mutex> hold(lock);
+	uint64_t now = nowNs();
+
+	out.utilisation = now > sinceNs ? (float) busyNs / (now - sinceNs) : 0;
+	out.transactions = transactions;
+	out.bytes = bytes;
+	out.requests = requests;
+	out.coalesced = coalesced;
+	out.addressSwitches = switches;
+	for (int p = 0; p < PRIORITIES; p++)
+		out.worstWaitUs[p] = worstWaitNs[p] / 1000.0f;
+
+	if (reset) {
+		sinceNs = now;
+		busyNs = 0;
+		transactions = bytes = requests = coalesced = switches = 0;
+		memset(worstWaitNs, 0, sizeof(worstWaitNs));
+	}
+}
+
+} // namespace lsm9ds0
@@ -0,0 +1,261 @@
+/**
+ * @file
+ * @brief Shares one I2C bus between every device and thread using it. The manager
+ * owns the bus's single file descriptor and runs each transaction from its own thread,
+ * taking requests from a queue, so transactions from different clients can never
+ * interleave.
+ *
+ * 		Addressing		The slave address is only changed when a transaction is for a
+ * 						different device than the one before it.
+ * 		Coalescing		Reads the caller marks as mergeable (registers with no side
+ * 						effects when read) queued for the same device, whose register
+ * 						ranges overlap or touch, are served by one burst and split
+ * 						between the clients. A joined burst never grows past
+ * 						MAX_BURST bytes or across a boundary set with splitAfter() (e.g.
+ * 						where the device's auto-increment wraps). Every other read is
+ * 						issued exactly as asked.
+ * 		Priorities		Each request carries the priority of the thread that made it
+ * 						(see PriorityScope); the queue is served highest priority
+ * 						first, oldest first within a priority, so a latency-sensitive
+ * 						thread (e.g. a data-ready handler) is never stuck behind a
+ * 						backlog of background reads.
+ * 		Utilisation		The time spent in transactions, their count and size, address
+ * 						switches, coalesced reads and the worst queueing delay of each
+ * 						priority are kept for stats().
+ *
+ * Requests block the calling thread until they are done, like a direct transaction.
+ * The transactions themselves go through an I2cTransport: the Edison's I2C bus through
+ * MRAA by default, or one the caller provides (e.g. a simulated bus off the board).
+ *
+ * e.g.: lsm9ds0::I2cManager bus(1);
+ * 		 uint8_t buf[6];
+ * 		 bus.read(0x1D, 0x28 | 0x80, buf, sizeof(buf));
+ */
+
+#ifndef I2C_MANAGER_HPP_
+#define I2C_MANAGER_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "mraa.hpp"
+
+namespace lsm9ds0 {
+
+/**
+ * Priority of a bus request
+ */
+enum Priority {
+	PRIORITY_HIGH = 0,
+	PRIORITY_NORMAL = 1,
+	PRIORITY_LOW = 2,
+	PRIORITIES = 3
+};
+
+/**
+ * Sets the priority of the bus requests the current thread makes for as long as it
+ * is in scope (threads start at PRIORITY_NORMAL).
+ */
+class PriorityScope {
+public:
+	explicit PriorityScope(Priority priority);
+	~PriorityScope();
+
+private:
+	Priority saved;
+};
+
+/**
+ * Bus use since the last reset.
+ * 		utilisation		Fraction of the time a transaction was in progress
+ * 		transactions	Transactions issued
+ * 		bytes			Register bytes read and written
+ * 		requests		Requests served (more than transactions when reads coalesce)
+ * 		coalesced		Reads served by another request's burst
+ * 		addressSwitches	Times the slave address was changed
+ * 		worstWaitUs		Longest a request of each priority waited in the queue
+ */
+struct I2cStats {
+	float utilisation;
+	unsigned long transactions;
+	unsigned long bytes;
+	unsigned long requests;
+	unsigned long coalesced;
+	unsigned long addressSwitches;
+	float worstWaitUs[PRIORITIES];
+};
+
+/**
+ * The transactions an I2cManager issues. Only its thread calls these, one at a time.
+ */
+class I2cTransport {
+public:
+	virtual ~I2cTransport() {}
+
+	/**
+	 * Selects the device the following transactions are for.
+	 *
+	 * @return true on success
+	 */
+	virtual bool address(uint8_t addr) = 0;
+
+	/**
+	 * Reads consecutive bytes starting at a register.
+	 *
+	 * @return Number of bytes read, or -1 on failure
+	 */
+	virtual int readBytesReg(uint8_t reg, uint8_t* buf, int len) = 0;
+
+	/**
+	 * Writes one register.
+	 *
+	 * @return true on success
+	 */
+	virtual bool writeReg(uint8_t reg, uint8_t value) = 0;
+};
+
+/**
+ * An Edison I2C bus through MRAA.
+ */
+class MraaI2c : public I2cTransport {
+public:
+	explicit MraaI2c(int bus) : i2c(bus) {}
+
+	bool address(uint8_t addr) {
+		return i2c.address(addr) == mraa::SUCCESS;
+	}
+
+	int readBytesReg(uint8_t reg, uint8_t* buf, int len) {
+		return i2c.readBytesReg(reg, buf, len);
+	}
+
+	bool writeReg(uint8_t reg, uint8_t value) {
+		return i2c.writeReg(reg, value) == mraa::SUCCESS;
+	}
+
+private:
+	mraa::I2c i2c;
+};
+
+/**
+ * Longest burst a mergeable read can be joined into
+ */
+const int MAX_BURST = 64;
+
+/**
+ * One I2C bus, shared.
+ */
+class I2cManager {
+public:
+	/**
+	 * Opens the bus and starts the thread that runs its transactions.
+	 *
+	 * @param bus The I2C bus number
+	 */
+	explicit I2cManager(int bus);
+
+	/**
+	 * Runs the transactions on a transport the caller provides, which must outlive
+	 * the manager, and starts the thread that runs them.
+	 *
+	 * @param transport The bus
+	 */
+	explicit I2cManager(I2cTransport& transport);
+
+	/**
+	 * Finishes the requests already queued, then stops the thread.
+	 */
+	~I2cManager();
+
+	I2cManager(const I2cManager&) = delete;
+	I2cManager& operator=(const I2cManager&) = delete;
+
+	/**
+	 * Reads consecutive bytes from a device's registers.
+	 *
+	 * @param addr The device's address
+	 * @param reg The first register (with the device's auto-increment bit if wanted)
+	 * @param buf Where to store the bytes
+	 * @param len Number of bytes
+	 * @param mergeable Whether reading the registers has no side effects, so the read
+	 * 		  may be served by a burst shared with other mergeable reads
+	 *
+	 * @return Number of bytes read, or -1 on failure
+	 */
+	int read(uint8_t addr, uint8_t reg, uint8_t* buf, int len, bool mergeable = false);
+
+	/**
+	 * Writes one register of a device.
+	 *
+	 * @return true on success
+	 */
+	bool write(uint8_t addr, uint8_t reg, uint8_t value);
+
+	/**
+	 * Keeps joined bursts of a device from running from one register into the next,
+	 * e.g. the LSM9DS0's last output register, where auto-increment wraps while the
+	 * FIFO is on. Reads that cross it themselves are still issued as asked.
+	 *
+	 * @param addr The device's address
+	 * @param reg The last register a joined burst may end on
+	 */
+	void splitAfter(uint8_t addr, uint8_t reg);
+
+	/**
+	 * Bus use since the last reset.
+	 *
+	 * @param out Filled in with the statistics
+	 * @param reset Start counting again from now
+	 */
+	void stats(I2cStats& out, bool reset = true);
+
+private:
+	struct Request {
+		bool write;
+		bool mergeable;
+		uint8_t addr;
+		uint8_t reg;
+		uint8_t value;
+		uint8_t* buf;
+		int len;
+		int result;
+		bool done;
+		Priority priority;
+		uint64_t queuedNs;
+	};
+
+	int submit(Request& request);
+	int gather(Request* head, Request** riders, int& first, int& len);
+	bool splits(uint8_t addr, int first, int end) const;
+	void execute(Request* head);
+	bool select(uint8_t addr, bool& switched);
+	void start();
+	static void* run(void* self);
+
+	I2cTransport* i2c;
+	bool owned;
+	int current;
+	std::vector<uint16_t> boundaries; // address << 8 | last register
+	pthread_t thread;
+	bool stopping;
+	std::mutex lock;
+	std::condition_variable queued;
+	std::condition_variable finished;
+	std::deque<Request*> queue[PRIORITIES];
+
+	uint64_t sinceNs;
+	uint64_t busyNs;
+	unsigned long transactions;
+	unsigned long bytes;
+	unsigned long requests;
+	unsigned long coalesced;
+	unsigned long switches;
+	uint64_t worstWaitNs[PRIORITIES];
+};
+
+} // namespace lsm9ds0
+
+#endif /* I2C_MANAGER_HPP_ */
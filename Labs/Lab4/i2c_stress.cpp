@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include "i2c_manager.hpp"
+
+/*
+ * Off-device stress test of the shared bus in i2c_manager.hpp. Eight threads hammer an
+ * I2cManager running on a simulated transport with two devices: mergeable reads that
+ * overlap, touch and sit either side of a split point, reads of a register that
+ * changes every time it is read, reads longer than MAX_BURST with and without
+ * auto-increment, and high priority writes. The transport checks that transactions
+ * never overlap and that no joined burst crosses the split point; every client checks
+ * the bytes it gets back. Exits with 0 when nothing went wrong.
+ *
+ * Build with: g++ -std=c++11 -fsanitize=address i2c_stress.cpp i2c_manager.cpp -lmraa -lpthread -o i2c_stress
+ *
+ * @author Cameron Stanavige
+ * @version 10/19/2026
+ */
+
+// devices on the simulated bus, the register that counts up each time it is read,
+// and the last register a joined burst may end on
+#define XM 0x1D
+#define GYRO 0x6B
+#define POP_REG 0x29
+#define SPLIT_REG 0x2D
+#define AUTO 0x80
+
+// requests made by each thread
+#define ROUNDS 3000
+
+/*
+ * Two register files behind one bus. Each register reads back a fixed pattern, except
+ * POP_REG on XM, which counts every read.
+ */
+class FakeBus : public lsm9ds0::I2cTransport {
+public:
+	FakeBus() : current(0), inside(0), overlaps(0), crossings(0), pops(0) {}
+
+	static uint8_t pattern(uint8_t addr, int reg) {
+		return (uint8_t) (addr * 7 + reg);
+	}
+
+	bool address(uint8_t addr) {
+		enter();
+		current = addr;
+		leave();
+		return true;
+	}
+
+	int readBytesReg(uint8_t reg, uint8_t* buf, int len) {
+		bool increment = (reg & AUTO) != 0;
+		int r = reg & ~AUTO;
+
+		enter();
+		if (increment && r <= SPLIT_REG && r + len - 1 > SPLIT_REG)
+			crossings++;
+		for (int i = 0; i < len; i++) {
+			buf[i] = current == XM && r == POP_REG ? (uint8_t) pops++ : pattern(current, r);
+			if (increment)
+				r = (r + 1) & 0x7F;
+		}
+		usleep(20); // about a short transaction at 400 kHz, so requests queue up
+		leave();
+		return len;
+	}
+
+	bool writeReg(uint8_t reg, uint8_t value) {
+		enter();
+		usleep(10);
+		leave();
+		return true;
+	}
+
+	uint8_t current;
+	std::atomic<int> inside;
+	std::atomic<unsigned long> overlaps, crossings, pops;
+
+private:
+	void enter() {
+		if (inside.fetch_add(1) != 0)
+			overlaps++;
+	}
+
+	void leave() {
+		inside--;
+	}
+};
+
+static lsm9ds0::I2cManager* bus;
+static std::atomic<unsigned long> errors(0), popReads(0);
+
+/*
+ * Checks a read returned len bytes of a device's pattern from reg on.
+ */
+static void expect(int result, uint8_t addr, uint8_t reg, const uint8_t* buf, int len) {
+	bool increment = (reg & AUTO) != 0;
+	if (result != len) {
+		errors++;
+		return;
+	}
+	for (int i = 0; i < len; i++) {
+		if (buf[i] != FakeBus::pattern(addr, (reg & ~AUTO) + (increment ? i : 0))) {
+			errors++;
+			return;
+		}
+	}
+} // end expect
+
+// mergeable reads that overlap or touch, and end on the split point
+static void* polled(void* args) {
+	uint8_t buf[8];
+	for (int i = 0; i < ROUNDS; i++) {
+		expect(bus->read(XM, 0x08 | AUTO, buf, 6, true), XM, 0x08 | AUTO, buf, 6);
+		expect(bus->read(XM, 0x05 | AUTO, buf, 4, true), XM, 0x05 | AUTO, buf, 4);
+		expect(bus->read(XM, 0x2A | AUTO, buf, 4, true), XM, 0x2A | AUTO, buf, 4);
+	}
+	return NULL;
+} // end polled
+
+// mergeable reads starting just after the split point
+static void* pastSplit(void* args) {
+	uint8_t buf[2];
+	for (int i = 0; i < 3 * ROUNDS; i++)
+		expect(bus->read(XM, 0x2E | AUTO, buf, 2, true), XM, 0x2E | AUTO, buf, 2);
+	return NULL;
+} // end pastSplit
+
+// reads with a side effect, touching the polled ones, which must each reach the device
+static void* popping(void* args) {
+	uint8_t value;
+	for (int i = 0; i < ROUNDS; i++) {
+		if (bus->read(XM, POP_REG | AUTO, &value, 1) != 1)
+			errors++;
+		popReads++;
+	}
+	return NULL;
+} // end popping
+
+// reads longer than MAX_BURST, with and without auto-increment (clear of the split
+// point and POP_REG, which the test's own reads never cross)
+static void* longReads(void* args) {
+	uint8_t buf[100];
+	for (int i = 0; i < ROUNDS / 10; i++) {
+		expect(bus->read(XM, 0x05, buf, sizeof(buf), true), XM, 0x05, buf, sizeof(buf));
+		expect(bus->read(GYRO, 0x30 | AUTO, buf, 80, true), GYRO, 0x30 | AUTO, buf, 80);
+	}
+	return NULL;
+} // end longReads
+
+// urgent traffic on the other device
+static void* urgent(void* args) {
+	lsm9ds0::PriorityScope high(lsm9ds0::PRIORITY_HIGH);
+	uint8_t buf[6];
+	for (int i = 0; i < ROUNDS; i++) {
+		if (!bus->write(GYRO, 0x20, (uint8_t) i))
+			errors++;
+		expect(bus->read(GYRO, 0x28 | AUTO, buf, 6, true), GYRO, 0x28 | AUTO, buf, 6);
+	}
+	return NULL;
+} // end urgent
+
+int main(int argc, char* argv[]) {
+	void* (*work[8])(void*) = { &polled, &polled, &pastSplit, &popping, &popping, &longReads,
+			&longReads, &urgent };
+	pthread_t threads[8];
+	lsm9ds0::I2cStats stats;
+	FakeBus fake;
+	bool ok;
+
+	bus = new lsm9ds0::I2cManager(fake);
+	bus->splitAfter(XM, SPLIT_REG);
+	bus->splitAfter(GYRO, SPLIT_REG);
+	for (int i = 0; i < 8; i++)
+		pthread_create(&threads[i], NULL, work[i], NULL);
+	for (int i = 0; i < 8; i++)
+		pthread_join(threads[i], NULL);
+	bus->stats(stats);
+	delete bus;
+
+	printf("%lu transactions for %lu requests (%lu coalesced), %lu address switches\n",
+			stats.transactions, stats.requests, stats.coalesced, stats.addressSwitches);
+	printf("worst wait: high %.0f us, normal %.0f us\n", stats.worstWaitUs[lsm9ds0::PRIORITY_HIGH],
+			stats.worstWaitUs[lsm9ds0::PRIORITY_NORMAL]);
+	printf("bad replies %lu, overlapping transactions %lu, bursts across the split %lu, "
+			"side-effect reads %lu of %lu\n", errors.load(), fake.overlaps.load(),
+			fake.crossings.load(), fake.pops.load(), popReads.load());
+
+	ok = errors == 0 && fake.overlaps == 0 && fake.crossings == 0 && fake.pops == popReads
+			&& stats.coalesced > 0;
+	printf("%s\n", ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+} // end main
@@ -0,0 +1,101 @@
+#include <string.h>
+#include "imu_bus.hpp"
+#include "lsm9ds0.hpp"
+
+namespace lsm9ds0 {
+
+SimBus::SimBus(uint8_t out, uint8_t status, uint8_t fifoEn) :
+		reads(0), writes(0), outReg(out), statusReg(status), fifoReg(fifoEn), first(0),
+		count(0) {
+	memset(regs, 0, sizeof(regs));
+}
+
+// FIFO_EN is the same bit in CTRL_REG0_XM and CTRL_REG5_G
+bool SimBus::fifoEnabled() const {
+	return fifoReg != 0 && (regs[fifoReg] & FIFO_EN) != 0;
+}
+
+bool SimBus::fifoRunning() const {
+	return fifoEnabled() && (regs[reg::FIFO_CTRL_REG.addr] & FIFO_MODE_MASK) != FIFO_MODE_BYPASS;
+}
+
+uint8_t SimBus::fifoSource() const {
+	int watermark = regs[reg::FIFO_CTRL_REG.addr] & FIFO_SRC_FSS;
+	uint8_t src = (uint8_t) (count & FIFO_SRC_FSS); // a full FIFO reads 0 with the overrun bit
+	if (count >= watermark)
+		src |= FIFO_SRC_WTM;
+	if (count == FIFO_DEPTH)
+		src |= FIFO_SRC_OVRN;
+	if (count == 0)
+		src |= FIFO_SRC_EMPTY;
+	return src;
+}
+
+// the output registers show the oldest sample in the FIFO
+void SimBus::loadOldest() {
+	if (count > 0)
+		memcpy(&regs[outReg], queued[first], 6);
+}
+
+int SimBus::readBytes(uint8_t reg, uint8_t* buf, int len) {
+	std::lock_guard<std::mutex> hold(lock);
+	bool increment = (reg & 0x80) != 0;
+	uint8_t r = reg & 0x7F;
+
+	reads++;
+	for (int i = 0; i < len; i++) {
+		buf[i] = fifoReg != 0 && r == reg::FIFO_SRC_REG.addr ? fifoSource() : regs[r];
+		if (r == outReg + 5) {
+			// reading the output registers clears the new-data and overrun flags, and
+			// takes the sample out of the FIFO
+			if (statusReg != 0)
+				regs[statusReg] &= ~(STATUS_ZYXDA | STATUS_ZYXOR);
+			if (fifoRunning() && count > 0) {
+				first = (first + 1) % FIFO_DEPTH;
+				count--;
+				loadOldest();
+			}
+		}
+		if (!increment)
+			continue;
+		r = (fifoEnabled() && r == outReg + 5) ? outReg : (r + 1) & 0x7F;
+	}
+	return len;
+}
+
+bool SimBus::writeReg(uint8_t reg, uint8_t value) {
+	std::lock_guard<std::mutex> hold(lock);
+	writes++;
+	regs[reg & 0x7F] = value;
+	if (!fifoRunning())
+		first = count = 0; // bypass mode empties the FIFO
+	return true;
+}
+
+void SimBus::setOutput(int16_t x, int16_t y, int16_t z) {
+	std::lock_guard<std::mutex> hold(lock);
+	int16_t v[3] = { x, y, z };
+	uint8_t bytes[6];
+	for (int i = 0; i < 3; i++) {
+		bytes[2 * i] = (uint8_t) (v[i] & 0xFF);
+		bytes[2 * i + 1] = (uint8_t) ((uint16_t) v[i] >> 8);
+	}
+	if (fifoRunning()) {
+		if (count == FIFO_DEPTH) { // stream mode: the oldest sample is overwritten
+			first = (first + 1) % FIFO_DEPTH;
+			count--;
+		}
+		memcpy(queued[(first + count) % FIFO_DEPTH], bytes, 6);
+		count++;
+		loadOldest();
+	} else {
+		memcpy(&regs[outReg], bytes, 6);
+	}
+	if (statusReg != 0) {
+		if (regs[statusReg] & STATUS_ZYXDA)
+			regs[statusReg] |= STATUS_ZYXOR;
+		regs[statusReg] |= STATUS_ZYXDA;
+	}
+}
+
+} // namespace lsm9ds0
@@ -0,0 +1,156 @@
+/**
+ * @file
+ * @brief Register access for the LSM9DS0 driver. The driver talks to each chip through
+ * a Bus, so it runs the same on the real I2C bus (I2cBus) or against a simulated
+ * register file (SimBus), which lets the driver and the programs using it be
+ * exercised off the Edison.
+ */
+
+#ifndef IMU_BUS_HPP_
+#define IMU_BUS_HPP_
+
+#include <stdint.h>
+#include <mutex>
+#include "i2c_manager.hpp"
+
+namespace lsm9ds0 {
+
+/**
+ * Samples each FIFO holds (declared here so SimBus's FIFO is sized from it too)
+ */
+const int FIFO_DEPTH = 32;
+
+/**
+ * Register access to one chip.
+ */
+class Bus {
+public:
+	virtual ~Bus() {}
+
+	/**
+	 * Reads consecutive bytes starting at a register (set the sub-address MSB for
+	 * the chip to auto-increment).
+	 *
+	 * @param reg The first register
+	 * @param buf Where to store the bytes
+	 * @param len Number of bytes
+	 *
+	 * @return Number of bytes read
+	 */
+	virtual int readBytes(uint8_t reg, uint8_t* buf, int len) = 0;
+
+	/**
+	 * Reads registers that have no side effects when read, like readBytes(). The bus
+	 * may serve the read with a burst shared with other such reads.
+	 */
+	virtual int readMergeable(uint8_t reg, uint8_t* buf, int len) {
+		return readBytes(reg, buf, len);
+	}
+
+	/**
+	 * Writes one register.
+	 *
+	 * @return true on success
+	 */
+	virtual bool writeReg(uint8_t reg, uint8_t value) = 0;
+};
+
+/**
+ * A chip on an Edison I2C bus. Its transactions go through the bus's manager, which
+ * serializes them with those of every other chip and thread on the bus.
+ */
+class I2cBus : public Bus {
+public:
+	I2cBus(I2cManager& manager, uint8_t addr) : manager(manager), addr(addr) {}
+
+	int readBytes(uint8_t reg, uint8_t* buf, int len) {
+		return manager.read(addr, reg, buf, len);
+	}
+
+	int readMergeable(uint8_t reg, uint8_t* buf, int len) {
+		return manager.read(addr, reg, buf, len, true);
+	}
+
+	bool writeReg(uint8_t reg, uint8_t value) {
+		return manager.write(addr, reg, value);
+	}
+
+private:
+	I2cManager& manager;
+	uint8_t addr;
+};
+
+/**
+ * A simulated chip: a register file that keeps what is written to it and returns it
+ * on reads. Sub-addresses with the MSB set auto-increment, wrapping from the last
+ * output register back to the first while the FIFO is enabled, as the LSM9DS0 does.
+ * Tests put samples in the output registers with setOutput().
+ *
+ * Given the register holding its FIFO_EN bit, the chip also has a FIFO_DEPTH sample
+ * FIFO in stream mode, driven by the same register writes as the real one: it runs
+ * while FIFO_EN is set and FIFO_CTRL_REG is out of bypass. Samples then queue in the
+ * FIFO, the output registers hold the oldest, reading its Z high byte pops it, and
+ * FIFO_SRC_REG reports the watermark, overrun, empty and stored-sample flags.
+ *
+ * e.g.: lsm9ds0::SimBus xm(0x28, 0x27, lsm9ds0::reg::CTRL_REG0_XM.addr);
+ * 		 lsm9ds0::SimBus g(0x28, 0x27, lsm9ds0::reg::CTRL_REG5_G.addr);
+ */
+class SimBus : public Bus {
+public:
+	/**
+	 * @param outReg First output register (X low) of the simulated sensor
+	 * @param statusReg Status register whose bit 3 flags new data (0 for none)
+	 * @param fifoReg Control register holding the FIFO_EN bit (0 for no FIFO)
+	 */
+	SimBus(uint8_t outReg = 0x28, uint8_t statusReg = 0x27, uint8_t fifoReg = 0);
+
+	int readBytes(uint8_t reg, uint8_t* buf, int len);
+	bool writeReg(uint8_t reg, uint8_t value);
+
+	/**
+	 * Stores a sample in the output registers, or queues it while the FIFO runs, and
+	 * flags it in the status register. If the previous sample was never read the
+	 * overrun bit is set too; a full FIFO drops its oldest sample.
+	 */
+	void setOutput(int16_t x, int16_t y, int16_t z);
+
+	/**
+	 * Sets a register directly, without counting it as a write
+	 */
+	void poke(uint8_t reg, uint8_t value) {
+		std::lock_guard<std::mutex> hold(lock);
+		regs[reg & 0x7F] = value;
+	}
+
+	/**
+	 * Value of a register
+	 */
+	uint8_t peek(uint8_t reg) {
+		std::lock_guard<std::mutex> hold(lock);
+		return regs[reg & 0x7F];
+	}
+
+	/**
+	 * Transactions seen
+	 */
+	unsigned long reads, writes;
+
+private:
+	bool fifoEnabled() const;
+	bool fifoRunning() const;
+	uint8_t fifoSource() const;
+	void loadOldest();
+
+	uint8_t regs[0x80];
+	uint8_t outReg;
+	uint8_t statusReg;
+	uint8_t fifoReg;
+	uint8_t queued[FIFO_DEPTH][6]; // samples of X/Y/Z, oldest at first
+	int first;
+	int count;
+	std::mutex lock;
+};
+
+} // namespace lsm9ds0
+
+#endif /* IMU_BUS_HPP_ */
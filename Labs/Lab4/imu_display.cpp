@@ -1,145 +1,161 @@
 #include <iostream>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include "mraa.hpp"
 #include "oled/Edison_OLED.h"
+#include "../Lab6/gesture.h"
+#include "../Lab6/button.hpp"
+#include "../Lab6/button_state.h"
+#include "../Lab6/button_lines.h"
+#include "lsm9ds0.hpp"
+#include "imu_drdy.hpp"
+#include "imu_snapshot.hpp"
+#include "fusion.hpp"
+#include "imu_scheduler.hpp"
 using namespace std;
 
 /*
  * This program is the set up for using the 9-degrees of freedom board on the Intel
  * Edison microcontroller. This will set the address on the I2C, write to the
- * registers, read and assemble the incoming data. It will then output the data to
- * the edOLED screen of the Edison.
+ * registers once, then read and assemble the incoming data (each sensor's X/Y/Z output
+ * in one burst read, see lsm9ds0.hpp). It will then output the data to the edOLED
+ * screen of the Edison.
+ *
+ * Sampling and drawing run separately. A sensor thread reads the sensor at its own
+ * rates and publishes the latest reading of each sensor (see imu_snapshot.hpp); the
+ * display loop draws the current page from those readings every FRAME_MS, so a slow
+ * redraw never delays a sample and sampling never blocks a redraw.
+ *
+ * When the sensor's data-ready lines are wired to GPIO pins, give the pins on the
+ * command line (imu_display <accel pin> <gyro pin>) and each accelerometer and gyro
+ * sample is read as its data-ready line rises (see imu_drdy.hpp). Otherwise they
+ * collect in the sensor's FIFOs, which the sensor thread empties.
+ *
+ * Every gyro sample also updates the orientation of the sensor (see fusion.hpp),
+ * computed in floating point, or in fixed point when built with -DIMU_FIXED_POINT.
  *
  * The Up, Down, and Select buttons will be initialized starting out on a welcome
- * page. The Up and Down buttons will scroll through 5 pages:
+ * page. The Up and Down buttons will scroll through 6 pages:
  * ~ Page 1: A welcome screen with simple instructions.
  * ~ Page 2: The temperature in C and F.
  * ~ Page 3: Acceleration
  * ~ Page 4: Gyroscope
  * ~ Page 5: Magnetometer
+ * ~ Page 6: Orientation (roll, pitch & yaw in degrees)
  *
  * *** THESE VALUES HAVE NOT BEEN CALIBRATED ***
  *
+ * Holding Up or Down keeps scrolling with an accelerating auto-repeat, and pressing
+ * Up & Down together jumps back to the welcome page.
+ *
  * The Select button will exit the program.
  *
  * @author Cameron Stanavige
  * @version 11/14/2015
  */
 
-// addresses
-#define XM_ADDR 0x1D
-#define G_ADDR  0x6B
-
-//temperature constants
-#define CTRL_REG5_XM  0x24
-#define OUT_TEMP_L_XM 0x05
-#define OUT_TEMP_H_XM 0x06
-
-// accelerometer constants
-#define CTRL_REG1_XM  0x20
-#define CTRL_REG2_XM  0x21
-#define OUT_X_L_A	  0X28
-#define OUT_X_H_A	  0X29
-#define OUT_Y_L_A	  0X2A
-#define OUT_Y_H_A	  0X2B
-#define OUT_Z_L_A	  0X2C
-#define OUT_Z_H_A	  0X2D
-
-// gyroscope constants
-#define CTRL_REG1_G   0x20
-//#define CTRL_REG2_G   0x21
-//#define CTRL_REG3_G   0x22
-//#define CTRL_REG4_G   0x23
-//#define CTRL_REG5_G   0x24
-#define OUT_X_L_G	  0x28
-#define OUT_X_H_G	  0x29
-#define OUT_Y_L_G	  0x2A
-#define OUT_Y_H_G	  0x2B
-#define OUT_Z_L_G	  0x2C
-#define OUT_Z_H_G	  0x2D
-
-// magnetometer constants
-#define CTRL_REG1_XM  0x20
-#define CTRL_REG5_XM  0x24
-#define CTRL_REG6_XM  0x25
-#define CTRL_REG7_XM  0x26
-#define OUT_X_L_M	  0x08
-#define OUT_X_H_M	  0x09
-#define OUT_Y_L_M	  0x0A
-#define OUT_Y_H_M	  0x0B
-#define OUT_Z_L_M	  0x0C
-#define OUT_Z_H_M	  0x0D
-
-// pins associated with each button
-#define PIN_UP  	47
-#define PIN_DOWN	44
-#define PIN_SELECT  48
-
-// struct to determine the debounced state of each button
-union {
-	unsigned char Buttons;
-	struct {
-		unsigned char Buttons_A :1;
-		unsigned char Buttons_B :1;
-		unsigned char Buttons_Up :1;
-		unsigned char Buttons_Down :1;
-		unsigned char Buttons_Left :1;
-		unsigned char Buttons_Right :1;
-		unsigned char Buttons_Select :1;
-		unsigned char Buttons_Bit7 :1;
-	} Buttons_bit;
-} Buttons;
-
-// simplified reference to each debounced button
-#define DB_Up 		Buttons.Buttons_bit.Buttons_Up
-#define DB_Down		Buttons.Buttons_bit.Buttons_Down
-#define DB_Select	Buttons.Buttons_bit.Buttons_Select
-#define BIT7		0x80
-
-// debounce thresholds
-#define PRESS_THRESHOLD 	0x3F
-#define RELEASE_THRESHOLD 	0xFC
-
-// button
-mraa::Gpio* button_Up;
-mraa::Gpio* button_Down;
-mraa::Gpio* button_Select;
-
-// display control
-static int volatile page = 1;
-static int volatile running = 0;
+// scan period of the button thread in microseconds when it falls back to MRAA
+#define BUTTON_SCAN_US	1000
+
+// time between redraws of the page in milliseconds
+#define FRAME_MS		100
+
+// sensor thread: ticks per second, the rate each polled sensor is read at (the
+// magnetometer at its output data rate), and how old a reading may be in milliseconds
+// before it is shown as an error
+#define SENSOR_RATE_HZ		50
+#define MAG_RATE_HZ			50
+#define TEMP_RATE_HZ		1
+#define STALE_MS			2000
+
+// display control (written by the button thread, read by the display loop)
+static std::atomic<int> page(1);
+static std::atomic<int> running(0);
+
+// long-press/repeat/chord handling on top of the debounced buttons
+struct gesture_recognizer gestures;
+
+// Select exits the program when it is released
+struct StopRunning {
+	static inline void run() {
+		running = 1;
+	}
+};
+
+// every button this program uses, debounced together in one loop
+typedef button::ButtonGroup<
+		button::Button<PIN_UP>,
+		button::Button<PIN_DOWN>,
+		button::Button<PIN_SELECT, button::NoAction, StopRunning> > Buttons;
+
+// latest reading of every sensor (written by the sensor threads, read by the display)
+static lsm9ds0::Snapshot latest;
+
+// the FIFO stream when the data-ready lines aren't wired, otherwise NULL
+static lsm9ds0::FifoStream* fifo = NULL;
+
+// orientation filter, updated by whichever thread reads the gyro
+#ifdef IMU_FIXED_POINT
+typedef lsm9ds0::Fusion<lsm9ds0::Fixed<24> > Fusion;
+#else
+typedef lsm9ds0::Fusion<float> Fusion;
+#endif
+static Fusion* fusion = NULL;
 
 // function prototypes
-int16_t assemble(uint8_t, uint8_t);
-int16_t assemble2(uint8_t, uint8_t);
+void onSample(lsm9ds0::Chip, const lsm9ds0::Sample&, void*);
+
+void* readSensors(void*);
+
+uint64_t nowNs();
 
-void printTemp(mraa::I2c*, edOLED*);
-float getTemp(mraa::I2c*);
+void fuse(lsm9ds0::Chip, const lsm9ds0::Sample&);
 
-void printGyro(mraa::I2c*, edOLED*);
+void drainFifo(bool);
 
-void printAccel(mraa::I2c*, edOLED*);
+void printTemp(edOLED*);
 
-void printMag(mraa::I2c*, edOLED*);
+void printAttitude(edOLED*);
+
+void printAxes(edOLED*, const char*, const lsm9ds0::Sample&);
 
 void printWelcome(edOLED*);
 
-void interrupt_Up(void*);
-void interrupt_Down(void*);
-void interrupt_Select(void*);
+void* scanButtons(void*);
+void onGesture(const struct gesture_event*, void*);
 
 /*
- * Main method to run this program. Sets up the I2Cs, buttons, and interrupts. Then
+ * Main method to run this program. Sets up the sensor and the button thread. Then
  * runs a continuous loop that switches through the available pages as they are
  * selected until the exit button is pressed.
  */
 int main(int argc, char* argv[]) {
-	// temp-accel-mag i2c
-	mraa::I2c* i2c = new mraa::I2c(1);
-	i2c->address(XM_ADDR);
-
-	// gyro i2c
-	mraa::I2c* i2cG = new mraa::I2c(1);
-	i2cG->address(G_ADDR);
+	// temp-accel-mag and gyro on one shared i2c bus, configured once for every page
+	lsm9ds0::I2cManager bus(1);
+	lsm9ds0::Device imu(bus);
+	if (!imu.configure(lsm9ds0::Config()))
+		cerr << "Couldn't configure the LSM9DS0" << endl;
+	fusion = new Fusion(lsm9ds0::gyroSensitivity(imu.cached(lsm9ds0::reg::CTRL_REG4_G)));
+
+	// accelerometer and gyro samples are read on their data-ready lines if they're
+	// wired, or collect in the sensor's FIFOs for the sensor thread
+	lsm9ds0::DrdySampler sampler(imu, &onSample, NULL);
+	lsm9ds0::FifoStream stream(imu);
+	lsm9ds0::DrdyPins pins;
+	if (argc == 3) {
+		pins.accel = atoi(argv[1]);
+		pins.gyro = atoi(argv[2]);
+	}
+	if (argc != 3 || !sampler.start(pins)) {
+		if (argc == 3)
+			cerr << "Couldn't watch the LSM9DS0 data-ready pins, using the FIFOs" << endl;
+		sampler.stop();
+		fifo = &stream;
+		if (!stream.start())
+			cerr << "Couldn't start the LSM9DS0 FIFOs" << endl;
+	}
 
 	// oled display setup
 	edOLED* oled = new edOLED();
@@ -149,262 +165,266 @@ int main(int argc, char* argv[]) {
 
 	//button setups
 
-	Buttons.Buttons = 0xFF;
-
-	// up_button
-	button_Up = new mraa::Gpio(PIN_UP, true, true);
-	button_Up->dir(mraa::DIR_IN);
-
-	button_Up->isr(mraa::EDGE_BOTH, &interrupt_Up, NULL);
-
-	// down_button
-	button_Down = new mraa::Gpio(PIN_DOWN, true, true);
-	button_Down->dir(mraa::DIR_IN);
-
-	button_Down->isr(mraa::EDGE_BOTH, &interrupt_Down, NULL);
-
-	// select button
-	button_Select = new mraa::Gpio(PIN_SELECT, true, true);
-	button_Select->dir(mraa::DIR_IN);
+	// Up & Down scroll and repeat while held; both together go to the welcome page
+	struct gesture_config gestureConfig;
+	gesture_config_default(&gestureConfig);
+	gestureConfig.repeat_mask = BUTTON_BIT_UP | BUTTON_BIT_DOWN;
+	gestureConfig.chords[0] = BUTTON_BIT_UP | BUTTON_BIT_DOWN;
+	gestureConfig.num_chords = 1;
+	gesture_init(&gestures, &gestureConfig, &onGesture, NULL);
 
-	button_Select->isr(mraa::EDGE_BOTH, &interrupt_Select, NULL);
+	pthread_t buttonThread, sensorThread;
+	pthread_create(&buttonThread, NULL, &scanButtons, NULL);
+	pthread_create(&sensorThread, NULL, &readSensors, &imu);
 
+	struct buttons_state state = buttons_snapshot();
 	while (running == 0) {
 		switch (page) {
 		case 1:
 			printWelcome(oled);
 			break;
 		case 2:
-			printTemp(i2c, oled);
+			printTemp(oled);
 			break;
 		case 3:
-			printAccel(i2c, oled);
+			printAxes(oled, "Accel", latest.accel.read());
 			break;
 		case 4:
-			printGyro(i2cG, oled);
+			printAxes(oled, "Gyro", latest.gyro.read());
 			break;
 		case 5:
-			printMag(i2c, oled);
+			printAxes(oled, "Mag", latest.mag.read());
+			break;
+		case 6:
+			printAttitude(oled);
 			break;
 		default:
 			page = 1;
 		}
 
-		usleep(4000);
+		// redraw every FRAME_MS, or right away when a button changes
+		buttons_wait_change(state.seq, FRAME_MS, &state);
 	}
 
 	// clean-up before exiting
 	oled->clear(PAGE);
 	oled->display();
-	delete i2c;
-	delete i2cG;
+	pthread_join(sensorThread, NULL);
+	if (fifo != NULL)
+		fifo->stop();
+	else
+		sampler.stop();
+	delete fusion;
 	delete oled;
-	button_Up->isrExit();
-	delete button_Up;
-	button_Down->isrExit();
-	delete button_Down;
-	button_Select->isrExit();
-	delete button_Select;
+	pthread_join(buttonThread, NULL);
+	gesture_destroy(&gestures);
+
+	lsm9ds0::I2cStats stats;
+	bus.stats(stats);
+	printf("i2c: %.1f%% busy, %lu transactions for %lu requests (%lu coalesced), "
+			"%lu address switches, worst wait %.0f us (data ready) %.0f us (polled)\n",
+			stats.utilisation * 100, stats.transactions, stats.requests, stats.coalesced,
+			stats.addressSwitches, stats.worstWaitUs[lsm9ds0::PRIORITY_HIGH],
+			stats.worstWaitUs[lsm9ds0::PRIORITY_NORMAL]);
 	return 0;
 }
 
 /*
- * Takes two unsigned 8-bit integers (a low and high) and converts them into one
- * 16-bit signed integer.
- *
- * @param low The lower 8 bits
- * @param hi The upper 8 bits
+ * Publishes a new accelerometer or gyro sample. Called from the data-ready thread.
  *
- * @return The combined 16-bit signed integer
+ * @param chip The sensor the sample is from
+ * @param sample The sample
+ * @param args Unused
  */
-int16_t assemble(uint8_t low, uint8_t hi) {
-	uint16_t l = (uint16_t) low;
-	uint16_t h = (uint16_t) hi;
-	return (int16_t) ((h << 8) | l);
+void onSample(lsm9ds0::Chip chip, const lsm9ds0::Sample& sample, void* args) {
+	(chip == lsm9ds0::XM ? latest.accel : latest.gyro).publish(sample);
+	fuse(chip, sample);
 }
 
 /*
- * Takes two unsigned 8-bit integers (a low and high) and converts them into one
- * 12-bit signed integer.
+ * Feeds an accelerometer or gyro sample to the orientation filter, and publishes the
+ * orientation after every gyro sample. Call from one thread only, in time order.
  *
- * @param low The lower 8 bits
- * @param hi The upper 4 bits
- *
- * @return The combined 12-bit signed integer
+ * @param chip The sensor the sample is from
+ * @param sample The sample
  */
-int16_t assemble2(uint8_t low, uint8_t hi) {
-	uint8_t temp;
-	if (hi >= 0x08) { // negative number
-		temp = 0xF0;
-		hi |= temp;
-	} else { // positive number
-		temp = 0x00;
-		hi ^= temp;
+void fuse(lsm9ds0::Chip chip, const lsm9ds0::Sample& sample) {
+	lsm9ds0::Attitude attitude;
+	if (chip == lsm9ds0::XM) {
+		fusion->setAccel(sample.v);
+		return;
 	}
-
-	return assemble(low, hi);
+	fusion->setMag(latest.mag.read().v);
+	if (fusion->update(sample, attitude))
+		latest.attitude.publish(attitude);
 }
 
 /*
- * Prints the device temperature to the screen.
+ * Thread that reads the sensor until the program is exiting, ticking on absolute
+ * deadlines SENSOR_RATE_HZ times a second. Every tick it checks the FIFOs (when the
+ * data-ready lines aren't used) and empties those that reached the watermark in one
+ * burst, flushing the rest on the way out, and the scheduler reads the magnetometer
+ * and the temperature at their own rates, together in one burst when both are due
+ * (see imu_scheduler.hpp). Readings that fail are left as they were.
  *
- * @param i2c The device address to write to/read from.
- * @param oled The OLED screen to print out to.
+ * @param args The configured sensor
  */
-void printTemp(mraa::I2c* i2c, edOLED* oled) {
-	i2c->writeReg(CTRL_REG5_XM, 0x98);
-
-	float temp = getTemp(i2c);
-
-	char* t = new char[6];
-	sprintf(t, "%.3f", temp);
-
-	oled->clear(PAGE);
-	oled->setCursor(0, 0);
-	oled->print("Temp");
-	oled->print("\nC: ");
-	oled->print(t);
-
-	temp = temp * (9.0/5) + 32;
-	sprintf(t, "%.3f", temp);
-
-	oled->print("\nF: ");
-	oled->print(t);
-
-	oled->display();
+void* readSensors(void* args) {
+	lsm9ds0::Device& imu = *(lsm9ds0::Device*) args;
+	lsm9ds0::Sample mag;
+	lsm9ds0::Temperature temp;
+	lsm9ds0::Scheduler scheduler(imu, SENSOR_RATE_HZ);
+	int magChannel = scheduler.add(lsm9ds0::XM, lsm9ds0::reg::OUT_X_L_M.addr, 6, MAG_RATE_HZ);
+	int tempChannel = scheduler.add(lsm9ds0::XM, lsm9ds0::reg::OUT_TEMP_L_XM.addr, 2, TEMP_RATE_HZ);
+	struct timespec deadline;
+	uint32_t read;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	while (running == 0) {
+		uint64_t now = nowNs();
+
+		drainFifo(false);
+		read = scheduler.tick(now);
+		if (read & (1u << magChannel)) {
+			mag.tNs = now;
+			mag.v = lsm9ds0::toVector(scheduler.data(magChannel));
+			latest.mag.publish(mag);
+		}
+		if (read & (1u << tempChannel)) {
+			temp.tNs = now;
+			temp.celsius = lsm9ds0::toCelsius(scheduler.data(tempChannel));
+			latest.temp.publish(temp);
+		}
 
-	usleep(500000);
+		deadline.tv_nsec += 1000000000L / SENSOR_RATE_HZ;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+	}
+	drainFifo(true); // whatever is left below the watermark
+	return NULL;
 }
 
 /*
- * Gets the temperature from the device.
- *
- * @param i2c The device address to write to/read from.
+ * Empties the FIFOs that reached the watermark, publishing the newest samples and
+ * passing every sample to the orientation filter. Does nothing when the data-ready
+ * lines are used instead.
  *
- * @return The temperature in C
+ * @param flush Empty the FIFOs even below the watermark
  */
-float getTemp(mraa::I2c* i2c) {
-	uint8_t lowTemp = i2c->readReg(OUT_TEMP_L_XM);
-	uint8_t hiTemp = i2c->readReg(OUT_TEMP_H_XM);
-	int16_t both = assemble2(lowTemp, hiTemp);
-
-	return (both / 8.0) + 21.0;
+void drainFifo(bool flush) {
+	lsm9ds0::Block accel, gyro;
+	int i, j;
+
+	if (fifo == NULL || !fifo->poll(accel, gyro, flush))
+		return;
+	if (accel.count > 0)
+		latest.accel.publish(accel.samples[accel.count - 1]);
+	if (gyro.count > 0)
+		latest.gyro.publish(gyro.samples[gyro.count - 1]);
+
+	// every sample to the orientation filter, merged in time order
+	for (i = 0, j = 0; i < gyro.count; i++) {
+		for (; j < accel.count && accel.samples[j].tNs <= gyro.samples[i].tNs; j++)
+			fuse(lsm9ds0::XM, accel.samples[j]);
+		fuse(lsm9ds0::G, gyro.samples[i]);
+	}
+	for (; j < accel.count; j++)
+		fuse(lsm9ds0::XM, accel.samples[j]);
 }
 
 /*
- * Prints the x, y, & z gyroscope values to the oled screen.
+ * Current time on the clock the readings are stamped with.
  *
- * @param i2cG The device address to write to/read from.
- * @param oled The OLED screen to print out to
+ * @return CLOCK_MONOTONIC in nanoseconds
  */
-void printGyro(mraa::I2c* i2cG, edOLED* oled) {
-	i2cG->writeReg(CTRL_REG1_G, 0x0F);
-//	i2cG->writeReg(CTRL_REG2_G, 0x00);
-//	i2cG->writeReg(CTRL_REG3_G, 0x00);
-//	i2cG->writeReg(CTRL_REG4_G, 0x00);
-//	i2cG->writeReg(CTRL_REG5_G, 0x00);
-
-	uint8_t xLow = i2cG->readReg(OUT_X_L_G);
-	uint8_t xHi = i2cG->readReg(OUT_X_H_G);
-
-	uint8_t yLow = i2cG->readReg(OUT_Y_L_G);
-	uint8_t yHi = i2cG->readReg(OUT_Y_H_G);
-
-	uint8_t zLow = i2cG->readReg(OUT_Z_L_G);
-	uint8_t zHi = i2cG->readReg(OUT_Z_H_G);
+uint64_t nowNs() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
 
-	int16_t x = assemble(xLow, xHi);
-	int16_t y = assemble(yLow, yHi);
-	int16_t z = assemble(zLow, zHi);
+/*
+ * Prints the latest device temperature to the screen.
+ *
+ * @param oled The OLED screen to print out to.
+ */
+void printTemp(edOLED* oled) {
+	lsm9ds0::Temperature reading = latest.temp.read();
+	float temp = reading.celsius;
+	char t[16];
 
 	oled->clear(PAGE);
 	oled->setCursor(0, 0);
-	oled->print("Gyro\n");
-	oled->print("X: ");
-	oled->print(x);
-	oled->print("\nY: ");
-	oled->print(y);
-	oled->print("\nZ: ");
-	oled->print(z);
+	oled->print("Temp");
+	if (reading.tNs != 0 && nowNs() - reading.tNs < STALE_MS * 1000000ULL) {
+		sprintf(t, "%.3f", temp);
+		oled->print("\nC: ");
+		oled->print(t);
+
+		temp = temp * (9.0/5) + 32;
+		sprintf(t, "%.3f", temp);
+
+		oled->print("\nF: ");
+		oled->print(t);
+	} else {
+		oled->print("\nI2C error");
+	}
 	oled->display();
-
-	usleep(500000);
 }
 
 /*
- * Prints the x, y, & z accelerometer values to the oled screen.
+ * Prints the latest orientation of the sensor to the oled screen.
  *
- * @param i2c The device address to write to/read from.
  * @param oled The OLED screen to print out to
  */
-void printAccel(mraa::I2c* i2c, edOLED* oled) {
-	i2c->writeReg(CTRL_REG1_XM, 0x47);
-	i2c->writeReg(CTRL_REG2_XM, 0xC0);
-
-	uint8_t xLow = i2c->readReg(OUT_X_L_A);
-	uint8_t xHi = i2c->readReg(OUT_X_H_A);
-
-	uint8_t yLow = i2c->readReg(OUT_Y_L_A);
-	uint8_t yHi = i2c->readReg(OUT_Y_H_A);
-
-	uint8_t zLow = i2c->readReg(OUT_Z_L_A);
-	uint8_t zHi = i2c->readReg(OUT_Z_H_A);
-
-	int16_t x = assemble(xLow, xHi);
-	int16_t y = assemble(yLow, yHi);
-	int16_t z = assemble(zLow, zHi);
+void printAttitude(edOLED* oled) {
+	lsm9ds0::Attitude attitude = latest.attitude.read();
+	char t[16];
 
 	oled->clear(PAGE);
 	oled->setCursor(0, 0);
-	oled->print("Accel\n");
-	oled->print("X: ");
-	oled->print(x);
-	oled->print("\nY: ");
-	oled->print(y);
-	oled->print("\nZ: ");
-	oled->print(z);
+	oled->print("Orient");
+	if (attitude.tNs != 0 && nowNs() - attitude.tNs < STALE_MS * 1000000ULL) {
+		sprintf(t, "%.1f", attitude.roll);
+		oled->print("\nR: ");
+		oled->print(t);
+		sprintf(t, "%.1f", attitude.pitch);
+		oled->print("\nP: ");
+		oled->print(t);
+		sprintf(t, "%.1f", attitude.yaw);
+		oled->print("\nY: ");
+		oled->print(t);
+	} else {
+		oled->print("\nI2C error");
+	}
 	oled->display();
-
-	usleep(500000);
 }
 
 /*
- * Prints the x, y, & z magnetometer values to the oled screen.
+ * Prints a sensor's latest x, y, & z values to the oled screen.
  *
- * @param i2c The device address to write to/read from.
  * @param oled The OLED screen to print out to
+ * @param title The name of the sensor
+ * @param sample The latest sample; an error is shown if it is missing or stale
  */
-void printMag(mraa::I2c* i2c, edOLED* oled) {
-	i2c->writeReg(CTRL_REG1_XM, 0x47);
-	i2c->writeReg(CTRL_REG5_XM, 0x18);
-	i2c->writeReg(CTRL_REG6_XM, 0x20);
-	i2c->writeReg(CTRL_REG7_XM, 0x00);
-
-	uint8_t xLow = i2c->readReg(OUT_X_L_M);
-	uint8_t xHi = i2c->readReg(OUT_X_H_M);
-
-	uint8_t yLow = i2c->readReg(OUT_Y_L_M);
-	uint8_t yHi = i2c->readReg(OUT_Y_H_M);
-
-	uint8_t zLow = i2c->readReg(OUT_Z_L_M);
-	uint8_t zHi = i2c->readReg(OUT_Z_H_M);
-
-	int16_t x = assemble(xLow, xHi);
-	int16_t y = assemble(yLow, yHi);
-	int16_t z = assemble(zLow, zHi);
-
+void printAxes(edOLED* oled, const char* title, const lsm9ds0::Sample& sample) {
 	oled->clear(PAGE);
 	oled->setCursor(0, 0);
-	oled->print("Mag\n");
-	oled->print("X: ");
-	oled->print(x);
-	oled->print("\nY: ");
-	oled->print(y);
-	oled->print("\nZ: ");
-	oled->print(z);
+	oled->print(title);
+	if (sample.tNs != 0 && nowNs() - sample.tNs < STALE_MS * 1000000ULL) {
+		oled->print("\nX: ");
+		oled->print(sample.v.x);
+		oled->print("\nY: ");
+		oled->print(sample.v.y);
+		oled->print("\nZ: ");
+		oled->print(sample.v.z);
+	} else {
+		oled->print("\nI2C error");
+	}
 	oled->display();
-
-	usleep(500000);
 }
 
 /*
@@ -420,106 +440,79 @@ void printWelcome(edOLED* oled) {
 }
 
 /*
- * ISR for the Up button. When pressed, will increment the page.
+ * Handles the gestures recognized on the buttons. Up & Down change the page on
+ * every press and repeat, pressing both together returns to the welcome page.
+ *
+ * @param event The gesture that was recognized
+ * @param args Unused
  */
-void interrupt_Up(void* args) {
-	int value_Up;
-	while (running == 0) {
-		static uint8_t UshiftReg = 0xFF; // shift register
-
-		value_Up = button_Up->read(); // read button value
-
-		UshiftReg >>= 1;
-
-		if (value_Up == 1) { // reset register if not pressed
-			UshiftReg |= BIT7;
-		}
-
-		if (DB_Up == 0) { // button released
-			if (UshiftReg >= RELEASE_THRESHOLD) {
-				//cout << "Up released" << endl;
-				DB_Up = 1;
-			}
-		} else { // button pressed
-			if (UshiftReg <= PRESS_THRESHOLD) {
-				//cout << "Up pressed" << endl;
-				if (page == 5)
-					page = 1;
-				else
-					page++;
-				DB_Up = 0;
-			}
-		}
-		usleep(1000);
+void onGesture(const struct gesture_event* event, void* args) {
+	switch (event->type) {
+	case GESTURE_PRESS:
+	case GESTURE_REPEAT:
+		if (event->mask == BUTTON_BIT_UP)
+			page = page == 6 ? 1 : page + 1;
+		else if (event->mask == BUTTON_BIT_DOWN)
+			page = page == 1 ? 6 : page - 1;
+		break;
+	case GESTURE_CHORD:
+		page = 1;
+		break;
+	default:
+		break;
 	}
-	usleep(500);
-} // end Up
+}
 
 /*
- * ISR for the Down button. When pressed, will decrement the current page.
+ * Thread that watches the buttons. Reads Up, Down and Select together through the
+ * GPIO character device (see button_lines.h), sleeping until an edge, a line settles
+ * or a held button's next gesture is due, or when that can't be opened debounces them
+ * through MRAA in a single loop.
+ * Either way the debounced state feeds the gestures until the program is exiting.
+ *
+ * @param args Unused
  */
-void interrupt_Down(void* args) {
-	int value_Down;
-	while (running == 0) {
-		static uint8_t DshiftReg = 0xFF; // shift register
-
-		value_Down = button_Down->read(); // read button value
-
-		DshiftReg >>= 1;
-
-		if (value_Down == 1) { // reset register if not pressed
-			DshiftReg |= BIT7;
-		}
-
-		if (DB_Down == 0) { // button released
-			if (DshiftReg >= RELEASE_THRESHOLD) {
-				//cout << "Down released" << endl;
-				DB_Down = 1;
-			}
-		} else { // button pressed
-			if (DshiftReg <= PRESS_THRESHOLD) {
-				//cout << "Down pressed" << endl;
-				if (page == 1)
-					page = 5;
-				else
-					page--;
-				DB_Down = 0;
+void* scanButtons(void* args) {
+	static const int pins[3] = { PIN_UP, PIN_DOWN, PIN_SELECT };
+	struct button_lines lines;
+	uint8_t pressed, last = 0;
+
+	if (button_lines_open(&lines, BUTTON_LINES_CHIP, pins, 3) == 0) {
+		// button_lines_update() publishes the changes itself
+		while (running == 0) {
+			// sleeps until an edge, a settle deadline or the next gesture deadline
+			int timeout = gesture_next_timeout_ms(&gestures, gesture_now_ms());
+			if (button_lines_wait(&lines, timeout) < 0 || button_lines_update(&lines, &pressed) < 0)
+				break;
+			uint32_t now = gesture_now_ms();
+			if (pressed != last) {
+				gesture_update(&gestures, pressed, now);
+				if (last & ~pressed & BUTTON_BIT_SELECT)
+					StopRunning::run();
+				last = pressed;
 			}
+			gesture_tick(&gestures, now);
 		}
-		usleep(1000);
+		button_lines_close(&lines);
+		if (running != 0)
+			return NULL;
+		last = 0; // the lines failed: carry on through MRAA
 	}
-	usleep(500);
-} // end Down
 
-/*
- * ISR for the Select button. When pressed, will exit the program.
- */
-void interrupt_Select(void* args) {
-	int value_Select;
+	Buttons buttons;
 	while (running == 0) {
-		static uint8_t SshiftReg = 0xFF; // shift register
-
-		value_Select = button_Select->read(); // read button value
-
-		SshiftReg >>= 1;
-
-		if (value_Select == 1) { // reset register if not pressed
-			SshiftReg |= BIT7;
+		pressed = buttons.scan();
+		uint32_t now = gesture_now_ms();
+		if (pressed != last) {
+			buttons_publish(pressed & ~last, last & ~pressed);
+			gesture_update(&gestures, pressed, now);
+			last = pressed;
 		}
+		gesture_tick(&gestures, now); // fire repeats while held
 
-		if (DB_Select == 0) { // button released
-			if (SshiftReg >= RELEASE_THRESHOLD) {
-				//cout << "Select released" << endl;
-				running = 1;
-				DB_Select = 1;
-			}
-		} else { // button pressed
-			if (SshiftReg <= PRESS_THRESHOLD) {
-				//cout << "Select pressed" << endl;
-				DB_Select = 0;
-			}
-		}
-		usleep(1000);
+		// MRAA has to be sampled to debounce, so the scan period is the longest sleep
+		int timeout = gesture_next_timeout_ms(&gestures, now);
+		usleep(timeout >= 0 && timeout * 1000 < BUTTON_SCAN_US ? timeout * 1000 : BUTTON_SCAN_US);
 	}
-	usleep(500);
-} // end Select
+	return NULL;
+} // end scanButtons
@@ -0,0 +1,181 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "imu_drdy.hpp"
+
+namespace lsm9ds0 {
+
+// how long the thread waits for an edge before checking for a sample whose edge was
+// lost (and whether it should stop)
+static const long DRDY_TIMEOUT_NS = 100000000L;
+
+static uint64_t nowNs() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static uint8_t statusReg(Chip chip) {
+	return chip == XM ? reg::STATUS_REG_A.addr : reg::STATUS_REG_G.addr;
+}
+
+DrdySampler::DrdySampler(Device& device, Handler h, void* a) :
+		imu(device), handler(h), args(a), fd(-1), routed(false), threadRunning(false),
+		stopping(false) {
+	offset[XM] = offset[G] = -1;
+	for (int c = 0; c < 2; c++)
+		taken[c] = lost[c] = empty[c] = 0;
+}
+
+DrdySampler::~DrdySampler() {
+	stop();
+}
+
+bool DrdySampler::requestLines(const DrdyPins& pins) {
+	struct gpio_v2_line_request request;
+	int chipFd;
+
+	memset(&request, 0, sizeof(request));
+	if (pins.accel >= 0)
+		request.offsets[request.num_lines++] = pins.accel;
+	if (pins.gyro >= 0)
+		request.offsets[request.num_lines++] = pins.gyro;
+	if (request.num_lines == 0)
+		return true;
+
+	strncpy(request.consumer, "lsm9ds0-drdy", sizeof(request.consumer) - 1);
+	request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+	request.event_buffer_size = 16 * request.num_lines;
+
+	chipFd = open(pins.chip, O_RDONLY | O_CLOEXEC);
+	if (chipFd < 0)
+		return false;
+	if (ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+		close(chipFd);
+		return false;
+	}
+	close(chipFd); // the line request keeps its own reference to the chip
+
+	fd = request.fd;
+	offset[XM] = pins.accel;
+	offset[G] = pins.gyro;
+	return true;
+}
+
+bool DrdySampler::start(const DrdyPins& pins) {
+	// with no pins the caller services both sensors itself
+	bool manual = pins.accel < 0 && pins.gyro < 0;
+	bool ok = true;
+
+	ok &= imu.update(reg::CTRL_REG3_XM, P1_DRDYA, manual || pins.accel >= 0 ? P1_DRDYA : 0);
+	ok &= imu.update(reg::CTRL_REG3_G, I2_DRDY, manual || pins.gyro >= 0 ? I2_DRDY : 0);
+	routed = true;
+	if (!ok || !requestLines(pins))
+		return false;
+	if (manual)
+		return true;
+
+	// a sample already waiting holds its line high, so no edge would ever come for it
+	if (offset[XM] >= 0)
+		service(XM, nowNs());
+	if (offset[G] >= 0)
+		service(G, nowNs());
+
+	stopping = false;
+	if (pthread_create(&thread, NULL, &run, this) != 0) {
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	threadRunning = true;
+	return true;
+}
+
+void DrdySampler::stop() {
+	if (threadRunning) {
+		stopping = true;
+		pthread_join(thread, NULL);
+		threadRunning = false;
+	}
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+		offset[XM] = offset[G] = -1;
+	}
+	if (routed) {
+		imu.update(reg::CTRL_REG3_XM, P1_DRDYA, 0);
+		imu.update(reg::CTRL_REG3_G, I2_DRDY, 0);
+		routed = false;
+	}
+}
+
+bool DrdySampler::service(Chip chip, uint64_t tNs) {
+	uint8_t buf[7];
+	Sample sample;
+
+	// status register, then X low through Z high, in one burst
+	if (imu.bus(chip).readBytes(statusReg(chip) | AUTO_INCREMENT, buf, sizeof(buf)) != sizeof(buf))
+		return false;
+	if (!(buf[0] & STATUS_ZYXDA)) {
+		empty[chip]++;
+		return true;
+	}
+	if (buf[0] & STATUS_ZYXOR)
+		lost[chip]++;
+
+	sample.tNs = tNs;
+	sample.v = toVector(buf + 1);
+	taken[chip]++;
+	handler(chip, sample, args);
+	return true;
+}
+
+void* DrdySampler::run(void* self) {
+	DrdySampler* s = (DrdySampler*) self;
+	PriorityScope urgent(PRIORITY_HIGH); // samples are read ahead of background reads
+	struct gpio_v2_line_event events[16];
+	struct pollfd pfd;
+	struct timespec timeout;
+	uint8_t status;
+	int c, i, n;
+
+	pfd.fd = s->fd;
+	pfd.events = POLLIN;
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = DRDY_TIMEOUT_NS;
+
+	while (!s->stopping) {
+		n = ppoll(&pfd, 1, &timeout, NULL);
+		if (n < 0 && errno != EINTR)
+			break;
+		if (n <= 0) {
+			// no edge for a while: a line stuck high means its sample is still unread,
+			// and reading it lets the line drop so the next edge can come
+			for (c = 0; c < 2; c++) {
+				Chip chip = (Chip) c;
+				if (s->offset[c] >= 0 && s->imu.bus(chip).readBytes(statusReg(chip), &status, 1) == 1
+						&& (status & STATUS_ZYXDA))
+					s->service(chip, nowNs());
+			}
+			continue;
+		}
+
+		n = read(s->fd, events, sizeof(events));
+		if (n < 0)
+			continue;
+		for (i = 0; i < n / (int) sizeof(events[0]); i++) {
+			if ((int) events[i].offset == s->offset[XM])
+				s->service(XM, events[i].timestamp_ns);
+			else if ((int) events[i].offset == s->offset[G])
+				s->service(G, events[i].timestamp_ns);
+		}
+	}
+	return NULL;
+}
+
+} // namespace lsm9ds0
@@ -0,0 +1,146 @@
+/**
+ * @file
+ * @brief Data-ready sampling of the LSM9DS0. Each sensor raises its data-ready line
+ * when a new sample is in its output registers and drops it once the sample has been
+ * read, so reading on every rising edge takes each sample exactly once, in step with
+ * the sensor's output data rate. The lines are watched through the GPIO character
+ * device (as the buttons are, see button_lines.h), whose edge events carry the
+ * kernel's timestamp of the interrupt; that becomes the time of the sample.
+ *
+ * The accelerometer's data ready comes out on INT1_XM and the gyro's on DRDY_G. On
+ * the SparkFun 9DOF block these have to be jumpered to GPIO pins, which are given to
+ * start().
+ *
+ * Every read starts at the status register, so one burst returns the new-data and
+ * overrun flags along with the sample. A sample overwritten before it was read is
+ * counted as missed, and an edge with no new data behind it as spurious.
+ *
+ * Use either a DrdySampler or a FifoStream, not both: with the FIFO on the output
+ * registers no longer hold a single sample.
+ *
+ * e.g.: void onSample(lsm9ds0::Chip chip, const lsm9ds0::Sample& s, void* args) { ... }
+ *
+ * 		 lsm9ds0::DrdySampler sampler(imu, &onSample, NULL);
+ * 		 lsm9ds0::DrdyPins pins;
+ * 		 pins.accel = ...; pins.gyro = ...;
+ * 		 sampler.start(pins);
+ *
+ * Off-device, start with no pins and call service() in place of the interrupt after
+ * each SimBus::setOutput().
+ */
+
+#ifndef IMU_DRDY_HPP_
+#define IMU_DRDY_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include "lsm9ds0.hpp"
+
+namespace lsm9ds0 {
+
+/**
+ * GPIO chip of the data-ready lines. On the Edison every GPIO is on gpiochip0, whose
+ * base is 0, so a raw pin number is also its line offset.
+ */
+const char* const DRDY_CHIP = "/dev/gpiochip0";
+
+/**
+ * Where the data-ready lines are wired; -1 for a sensor whose line isn't connected
+ * (it isn't sampled).
+ */
+struct DrdyPins {
+	const char* chip = DRDY_CHIP;
+	int accel = -1;
+	int gyro = -1;
+};
+
+/**
+ * Reads each accelerometer and gyro sample once, when its data-ready line rises.
+ */
+class DrdySampler {
+public:
+	/**
+	 * Called with every new sample, from the sampler's thread
+	 *
+	 * @param chip XM for the accelerometer, G for the gyro
+	 * @param sample The sample and the time its data-ready edge was seen
+	 * @param args The pointer given to the constructor
+	 */
+	typedef void (*Handler)(Chip chip, const Sample& sample, void* args);
+
+	/**
+	 * @param imu The configured sensor
+	 * @param handler Called with every sample
+	 * @param args Passed to the handler
+	 */
+	DrdySampler(Device& imu, Handler handler, void* args);
+
+	~DrdySampler();
+
+	DrdySampler(const DrdySampler&) = delete;
+	DrdySampler& operator=(const DrdySampler&) = delete;
+
+	/**
+	 * Routes data ready to the pins of the connected sensors, requests their lines
+	 * and starts the thread waiting on them. Any sample already waiting is read first,
+	 * as its line is high and would never give an edge.
+	 *
+	 * @param pins The lines to watch; with none given only the routing is done and
+	 * 			   the caller calls service()
+	 *
+	 * @return false if a register couldn't be written or the lines requested
+	 */
+	bool start(const DrdyPins& pins);
+
+	/**
+	 * Stops the thread, releases the lines and turns the data-ready outputs off.
+	 */
+	void stop();
+
+	/**
+	 * Reads the status and sample of one sensor in a single burst and hands the
+	 * sample to the handler if it is new.
+	 *
+	 * @param chip XM for the accelerometer, G for the gyro
+	 * @param tNs Time of the sample (CLOCK_MONOTONIC, nanoseconds)
+	 *
+	 * @return false if the read failed
+	 */
+	bool service(Chip chip, uint64_t tNs);
+
+	/**
+	 * Per sensor: samples handed over, samples overwritten before they were read,
+	 * and edges with no new sample
+	 */
+	unsigned long samples(Chip chip) const {
+		return taken[chip];
+	}
+	unsigned long missed(Chip chip) const {
+		return lost[chip];
+	}
+	unsigned long spurious(Chip chip) const {
+		return empty[chip];
+	}
+
+private:
+	static void* run(void* args);
+	bool requestLines(const DrdyPins& pins);
+
+	Device& imu;
+	Handler handler;
+	void* args;
+	int fd;
+	int offset[2];
+	bool routed;
+	pthread_t thread;
+	bool threadRunning;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned long> taken[2];
+	std::atomic<unsigned long> lost[2];
+	std::atomic<unsigned long> empty[2];
+};
+
+} // namespace lsm9ds0
+
+#endif /* IMU_DRDY_HPP_ */
@@ -0,0 +1,85 @@
+#include <string.h>
+#include "imu_scheduler.hpp"
+
+namespace lsm9ds0 {
+
+// last output register (Z high) of the accelerometer and gyro: with their FIFOs on,
+// auto-increment wraps from here back to X low, so no burst may run past it
+static const uint8_t OUT_Z_H = 0x2D;
+
+Scheduler::Scheduler(Device& device, float rate) :
+		imu(device), tickHz(rate), count(0), ticks(0), bursts(0), served(0) {
+}
+
+int Scheduler::add(Chip chip, uint8_t first, int len, float rateHz) {
+	if (count == SCHEDULER_CHANNELS || len < 1 || len > SCHEDULER_MAX_BYTES
+			|| first + len > REGISTERS || rateHz <= 0)
+		return -1;
+
+	Channel& c = channels[count];
+	c.chip = chip;
+	c.first = first;
+	c.len = len;
+	c.divisor = (unsigned int) (tickHz / rateHz + 0.5f);
+	if (c.divisor == 0)
+		c.divisor = 1;
+	c.tNs = 0;
+	memset(c.data, 0, sizeof(c.data));
+	return count++;
+}
+
+bool Scheduler::readBurst(Chip chip, uint8_t first, int len, const int* members, int n,
+		uint64_t nowNs) {
+	uint8_t buf[REGISTERS];
+	// polled registers: another client's read of them can share the burst
+	if (imu.bus(chip).readMergeable(first | AUTO_INCREMENT, buf, len) != len)
+		return false;
+	bursts++;
+	for (int i = 0; i < n; i++) {
+		Channel& c = channels[members[i]];
+		memcpy(c.data, buf + (c.first - first), c.len);
+		c.tNs = nowNs;
+		served++;
+	}
+	return true;
+}
+
+uint32_t Scheduler::tick(uint64_t nowNs) {
+	int due[SCHEDULER_CHANNELS], n = 0, i, j;
+	uint32_t read = 0;
+
+	// the channels due this tick, ordered by chip and first register
+	for (i = 0; i < count; i++) {
+		if (ticks % channels[i].divisor != 0)
+			continue;
+		for (j = n++; j > 0; j--) {
+			const Channel& a = channels[due[j - 1]];
+			if (a.chip < channels[i].chip
+					|| (a.chip == channels[i].chip && a.first <= channels[i].first))
+				break;
+			due[j] = due[j - 1];
+		}
+		due[j] = i;
+	}
+	ticks++;
+
+	// grow each burst while the next range is on the same chip and close enough
+	for (i = 0; i < n; i = j) {
+		const Channel& head = channels[due[i]];
+		int end = head.first + head.len;
+		for (j = i + 1; j < n; j++) {
+			const Channel& c = channels[due[j]];
+			int last = c.first + c.len > end ? c.first + c.len : end;
+			if (c.chip != head.chip || c.first > end + SCHEDULER_MAX_GAP
+					|| (head.first <= OUT_Z_H && last - 1 > OUT_Z_H))
+				break;
+			end = last;
+		}
+		if (readBurst(head.chip, head.first, end - head.first, due + i, j - i, nowNs))
+			for (int k = i; k < j; k++)
+				read |= 1u << due[k];
+	}
+	return read;
+}
+
+} // namespace lsm9ds0
@@ -0,0 +1,135 @@
+/**
+ * @file
+ * @brief Multi-rate register reads of the LSM9DS0. Each channel is a range of
+ * registers read at its own rate (the temperature once a second, the magnetometer at
+ * its output data rate, ...). On every tick the scheduler takes the channels that are
+ * due and packs them into as few bursts as it can: ranges on the same chip that
+ * overlap, touch, or are only a few registers apart are read in one auto-increment
+ * burst, since skipping a short gap costs less than starting another transaction.
+ *
+ * Channel rates are rounded to a whole number of ticks, and every channel is due on
+ * tick 0, so slower channels always fall on the same ticks as faster ones and can
+ * share their bursts (the temperature, 0x05-0x06 on XM, rides along with the
+ * magnetometer at 0x08-0x0D).
+ *
+ * The bursts are read as mergeable (see i2c_manager.hpp), so channels should be
+ * registers that can be read without side effects, not a FIFO or its status.
+ *
+ * e.g.: lsm9ds0::Scheduler scheduler(imu, 50);
+ * 		 int mag = scheduler.add(lsm9ds0::XM, lsm9ds0::reg::OUT_X_L_M.addr, 6, 50);
+ * 		 int temp = scheduler.add(lsm9ds0::XM, lsm9ds0::reg::OUT_TEMP_L_XM.addr, 2, 1);
+ * 		 for (;;) {
+ * 		 	uint32_t read = scheduler.tick(now);
+ * 		 	if (read & (1u << mag))
+ * 		 		... lsm9ds0::toVector(scheduler.data(mag)) ...
+ * 		 	... wait for the next tick ...
+ * 		 }
+ */
+
+#ifndef IMU_SCHEDULER_HPP_
+#define IMU_SCHEDULER_HPP_
+
+#include <stdint.h>
+#include "lsm9ds0.hpp"
+
+namespace lsm9ds0 {
+
+/**
+ * Most channels one scheduler runs (one bit each in the mask tick() returns)
+ */
+const int SCHEDULER_CHANNELS = 32;
+
+/**
+ * Most unwanted registers read to join two ranges into one burst. Another
+ * transaction costs a start, the address and sub-address and a repeated start, about
+ * four bytes on the wire.
+ */
+const int SCHEDULER_MAX_GAP = 3;
+
+/**
+ * Longest range one channel can read
+ */
+const int SCHEDULER_MAX_BYTES = 16;
+
+/**
+ * Reads register ranges of a Device, each at its own rate.
+ */
+class Scheduler {
+public:
+	/**
+	 * @param imu The configured sensor
+	 * @param tickHz How often tick() is called
+	 */
+	Scheduler(Device& imu, float tickHz);
+
+	/**
+	 * Adds a channel.
+	 *
+	 * @param chip The chip the registers are on
+	 * @param first The first register
+	 * @param len Number of registers (at most SCHEDULER_MAX_BYTES)
+	 * @param rateHz Reads per second (at most the tick rate)
+	 *
+	 * @return The channel number, or -1 if the scheduler is full or the range invalid
+	 */
+	int add(Chip chip, uint8_t first, int len, float rateHz);
+
+	/**
+	 * Reads every channel that is due, in as few bursts as possible.
+	 *
+	 * @param nowNs Time of the tick (CLOCK_MONOTONIC, nanoseconds), given to the
+	 * 				channels read
+	 *
+	 * @return Bit n set if channel n was read
+	 */
+	uint32_t tick(uint64_t nowNs);
+
+	/**
+	 * Registers of a channel from its latest read
+	 */
+	const uint8_t* data(int channel) const {
+		return channels[channel].data;
+	}
+
+	/**
+	 * Time of a channel's latest read, or 0 if it hasn't been read yet
+	 */
+	uint64_t time(int channel) const {
+		return channels[channel].tNs;
+	}
+
+	/**
+	 * Bursts issued, and the channel reads they served
+	 */
+	unsigned long transactions() const {
+		return bursts;
+	}
+	unsigned long reads() const {
+		return served;
+	}
+
+private:
+	struct Channel {
+		Chip chip;
+		uint8_t first;
+		int len;
+		unsigned int divisor;
+		uint64_t tNs;
+		uint8_t data[SCHEDULER_MAX_BYTES];
+	};
+
+	bool readBurst(Chip chip, uint8_t first, int len, const int* members, int count,
+			uint64_t nowNs);
+
+	Device& imu;
+	float tickHz;
+	int count;
+	unsigned long ticks;
+	unsigned long bursts;
+	unsigned long served;
+	Channel channels[SCHEDULER_CHANNELS];
+};
+
+} // namespace lsm9ds0
+
+#endif /* IMU_SCHEDULER_HPP_ */
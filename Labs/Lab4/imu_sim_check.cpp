@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include "lsm9ds0.hpp"
+#include "imu_drdy.hpp"
+
+/*
+ * Off-device check of the sampling paths in imu_drdy.hpp and lsm9ds0.hpp. Runs
+ * DrdySampler::service() and FifoStream::poll() against a pair of simulated chips
+ * (SimBus) and compares what they return with the samples put into the chips,
+ * including missed samples, edges with no data behind them and FIFO overruns.
+ * Exits with 0 when every check passes.
+ *
+ * Needs libmraa to link but never opens a bus, so it runs on any Linux machine.
+ * Build with: g++ -std=c++11 imu_sim_check.cpp lsm9ds0.cpp imu_bus.cpp imu_drdy.cpp i2c_manager.cpp -lmraa -lpthread -o imu_sim_check
+ *
+ * @author Cameron Stanavige
+ * @version 10/19/2026
+ */
+
+// samples put through each path
+#define DRDY_SAMPLES 10
+#define WATERMARK 8
+
+static int failures = 0;
+
+static void check(bool ok, const char * what) {
+	printf("  %-52s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok)
+		failures++;
+}
+
+// samples handed over by the data-ready sampler
+struct Received {
+	int count;
+	lsm9ds0::Sample last;
+};
+
+static void onSample(lsm9ds0::Chip chip, const lsm9ds0::Sample& sample, void* args) {
+	Received* received = (Received*) args;
+	received->count++;
+	received->last = sample;
+}
+
+/*
+ * Reads accelerometer samples one at a time as their data-ready edge would.
+ *
+ * @param imu The sensor on the simulated chips
+ * @param xm The simulated accelerometer/magnetometer chip
+ */
+static void checkDrdy(lsm9ds0::Device& imu, lsm9ds0::SimBus& xm) {
+	Received received = Received();
+	lsm9ds0::DrdySampler sampler(imu, &onSample, &received);
+	bool match = true;
+
+	printf("data ready\n");
+	check(sampler.start(lsm9ds0::DrdyPins()), "start without pins routes data ready");
+	check((xm.peek(lsm9ds0::reg::CTRL_REG3_XM.addr) & lsm9ds0::P1_DRDYA) != 0,
+			"P1_DRDYA set");
+
+	for (int i = 1; i <= DRDY_SAMPLES; i++) {
+		xm.setOutput(i, -i, 100 * i);
+		sampler.service(lsm9ds0::XM, i);
+		match &= received.count == i && received.last.tNs == (uint64_t) i
+				&& received.last.v.x == i && received.last.v.y == -i
+				&& received.last.v.z == 100 * i;
+	}
+	check(match, "every sample read with its edge time");
+
+	// two samples before an edge: the first is overwritten
+	xm.setOutput(1, 2, 3);
+	xm.setOutput(4, 5, 6);
+	sampler.service(lsm9ds0::XM, 0);
+	check(received.last.v.x == 4 && sampler.missed(lsm9ds0::XM) == 1, "overwritten sample counted as missed");
+
+	// an edge with no new sample behind it
+	sampler.service(lsm9ds0::XM, 0);
+	check(sampler.spurious(lsm9ds0::XM) == 1 && sampler.samples(lsm9ds0::XM) == DRDY_SAMPLES + 1,
+			"edge with no data counted as spurious");
+
+	sampler.stop();
+	check((xm.peek(lsm9ds0::reg::CTRL_REG3_XM.addr) & lsm9ds0::P1_DRDYA) == 0,
+			"stop clears P1_DRDYA");
+} // end checkDrdy
+
+/*
+ * Checks that a block holds consecutive samples with x counting up from first.
+ */
+static bool inOrder(const lsm9ds0::Block& block, int first) {
+	for (int i = 0; i < block.count; i++) {
+		const lsm9ds0::Vector& v = block.samples[i].v;
+		if (v.x != first + i || v.y != -(first + i) || v.z != 2 * (first + i))
+			return false;
+		if (i > 0 && block.samples[i].tNs <= block.samples[i - 1].tNs)
+			return false;
+	}
+	return true;
+} // end inOrder
+
+/*
+ * Streams gyro samples through the FIFO.
+ *
+ * @param imu The sensor on the simulated chips
+ * @param g The simulated gyro chip
+ */
+static void checkFifo(lsm9ds0::Device& imu, lsm9ds0::SimBus& g) {
+	lsm9ds0::FifoStream stream(imu, WATERMARK);
+	lsm9ds0::Block accel, gyro;
+	unsigned long reads;
+	int next = 0;
+
+	printf("FIFO\n");
+	check(stream.start(), "start");
+
+	for (int i = 0; i < WATERMARK - 1; i++, next++)
+		g.setOutput(next, -next, 2 * next);
+	check(stream.poll(accel, gyro) && gyro.count == 0 && accel.count == 0,
+			"nothing drained below the watermark");
+
+	g.setOutput(next, -next, 2 * next);
+	next++;
+	reads = g.reads;
+	check(stream.poll(accel, gyro) && gyro.count == WATERMARK && !gyro.overrun
+			&& inOrder(gyro, 0), "watermark drains every sample in order");
+	check(g.reads - reads == 2, "one status read and one burst");
+	check(stream.poll(accel, gyro, true) && gyro.count == 0, "FIFO empty afterwards");
+
+	// more than the FIFO holds: the oldest are lost
+	for (int i = 0; i < lsm9ds0::FIFO_DEPTH + 5; i++, next++)
+		g.setOutput(next, -next, 2 * next);
+	check(stream.poll(accel, gyro) && gyro.overrun && gyro.count == lsm9ds0::FIFO_DEPTH
+			&& inOrder(gyro, next - lsm9ds0::FIFO_DEPTH), "overrun keeps the newest FIFO_DEPTH samples");
+
+	g.setOutput(1, 2, 3);
+	check(stream.poll(accel, gyro, true) && gyro.count == 1 && gyro.samples[0].v.x == 1,
+			"flush drains below the watermark");
+
+	check(stream.stop(), "stop");
+	g.setOutput(7, 8, 9);
+	check(stream.poll(accel, gyro, true) && gyro.count == 0
+			&& g.peek(lsm9ds0::reg::OUT_X_L_G.addr) == 7, "bypass mode leaves the FIFO empty");
+} // end checkFifo
+
+int main(int argc, char* argv[]) {
+	lsm9ds0::SimBus xm(lsm9ds0::reg::OUT_X_L_A.addr, lsm9ds0::reg::STATUS_REG_A.addr,
+			lsm9ds0::reg::CTRL_REG0_XM.addr);
+	lsm9ds0::SimBus g(lsm9ds0::reg::OUT_X_L_G.addr, lsm9ds0::reg::STATUS_REG_G.addr,
+			lsm9ds0::reg::CTRL_REG5_G.addr);
+	lsm9ds0::Device imu(xm, g);
+
+	if (!imu.configure(lsm9ds0::Config())) {
+		printf("couldn't configure the simulated sensor\n");
+		return 1;
+	}
+	checkDrdy(imu, xm);
+	checkFifo(imu, g);
+
+	printf("%s\n", failures == 0 ? "all checks passed" : "some checks FAILED");
+	return failures == 0 ? 0 : 1;
+} // end main
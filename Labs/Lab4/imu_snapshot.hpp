@@ -0,0 +1,120 @@
+/**
+ * @file
+ * @brief Latest readings of the LSM9DS0 shared between the thread that samples the
+ * sensor and the threads that use the readings. Each reading is published through a
+ * seqlock: the writer never waits, and a reader copies the reading and retries in the
+ * rare case it was overwritten meanwhile, so a slow reader (e.g. one drawing to the
+ * OLED) can't hold up sampling and never sees half of one sample and half of another.
+ *
+ * Every reading has exactly one writer.
+ *
+ * e.g.: lsm9ds0::Snapshot latest;
+ * 		 // sensor thread
+ * 		 latest.accel.publish(sample);
+ * 		 // display thread
+ * 		 lsm9ds0::Sample accel = latest.accel.read();
+ */
+
+#ifndef IMU_SNAPSHOT_HPP_
+#define IMU_SNAPSHOT_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#include "lsm9ds0.hpp"
+#include "fusion.hpp"
+
+namespace lsm9ds0 {
+
+/**
+ * A value with one writer and any number of readers. The value is kept as atomic
+ * words so concurrent copies are well defined; the sequence number is odd while a
+ * write is in progress.
+ */
+template <typename T>
+class Seqlock {
+	static_assert(std::is_trivially_copyable<T>::value, "Seqlock values are copied as words");
+
+public:
+	Seqlock() : seq(0) {
+		T blank = T();
+		store(blank);
+	}
+
+	/**
+	 * Replaces the value. Never blocks; call from the one writer only.
+	 */
+	void publish(const T& value) {
+		uint32_t s = seq.load(std::memory_order_relaxed);
+		seq.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		store(value);
+		seq.store(s + 2, std::memory_order_release);
+	}
+
+	/**
+	 * Copies the latest complete value.
+	 */
+	T read() const {
+		T value;
+		uint32_t before, after;
+		do {
+			before = seq.load(std::memory_order_acquire);
+			load(value);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = seq.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+		return value;
+	}
+
+	/**
+	 * Number of values published so far
+	 */
+	uint32_t count() const {
+		return seq.load(std::memory_order_acquire) / 2;
+	}
+
+private:
+	static const int WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+	void store(const T& value) {
+		uint32_t buf[WORDS] = { 0 };
+		memcpy(buf, &value, sizeof(T));
+		for (int i = 0; i < WORDS; i++)
+			words[i].store(buf[i], std::memory_order_relaxed);
+	}
+
+	void load(T& value) const {
+		uint32_t buf[WORDS];
+		for (int i = 0; i < WORDS; i++)
+			buf[i] = words[i].load(std::memory_order_relaxed);
+		memcpy(&value, buf, sizeof(T));
+	}
+
+	std::atomic<uint32_t> seq;
+	std::atomic<uint32_t> words[WORDS];
+};
+
+/**
+ * A temperature with the time it was read (CLOCK_MONOTONIC, nanoseconds)
+ */
+struct Temperature {
+	uint64_t tNs;
+	float celsius;
+};
+
+/**
+ * The latest reading of every sensor. A reading whose time is 0 hasn't been taken yet.
+ */
+struct Snapshot {
+	Seqlock<Sample> accel;
+	Seqlock<Sample> gyro;
+	Seqlock<Sample> mag;
+	Seqlock<Temperature> temp;
+	Seqlock<Attitude> attitude;
+};
+
+} // namespace lsm9ds0
+
+#endif /* IMU_SNAPSHOT_HPP_ */
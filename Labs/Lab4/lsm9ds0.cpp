@@ -0,0 +1,247 @@
+#include <string.h>
+#include <time.h>
+#include "lsm9ds0.hpp"
+
+namespace lsm9ds0 {
+
+int16_t assemble(uint8_t low, uint8_t hi) {
+	uint16_t l = (uint16_t) low;
+	uint16_t h = (uint16_t) hi;
+	return (int16_t) ((h << 8) | l);
+}
+
+int16_t assemble12(uint8_t low, uint8_t hi) {
+	if (hi >= 0x08) // negative number: extend the sign through the top 4 bits
+		hi |= 0xF0;
+	return assemble(low, hi);
+}
+
+Vector toVector(const uint8_t* buf) {
+	Vector v;
+	v.x = assemble(buf[0], buf[1]);
+	v.y = assemble(buf[2], buf[3]);
+	v.z = assemble(buf[4], buf[5]);
+	return v;
+}
+
+float toCelsius(const uint8_t* buf) {
+	return (assemble12(buf[0], buf[1]) / 8.0) + 21.0;
+}
+
+bool readAxes(Bus& bus, uint8_t reg, Vector& out) {
+	uint8_t buf[6];
+	if (bus.readBytes(reg | AUTO_INCREMENT, buf, sizeof(buf)) != sizeof(buf))
+		return false;
+	out = toVector(buf);
+	return true;
+}
+
+bool readTemp(Bus& bus, uint8_t reg, float& celsius) {
+	uint8_t buf[2];
+	if (bus.readBytes(reg | AUTO_INCREMENT, buf, sizeof(buf)) != sizeof(buf))
+		return false;
+	celsius = toCelsius(buf);
+	return true;
+}
+
+// with the FIFO on, auto-increment wraps after Z high, so shared bursts stop there
+static void splitAtWrap(I2cManager& manager, uint8_t xmAddr, uint8_t gAddr) {
+	manager.splitAfter(xmAddr, reg::OUT_X_L_A.addr + 5);
+	manager.splitAfter(gAddr, reg::OUT_X_L_G.addr + 5);
+}
+
+Device::Device(int busNum, uint8_t xmAddr, uint8_t gAddr) :
+		manager(new I2cManager(busNum)), xm(new I2cBus(*manager, xmAddr)),
+		g(new I2cBus(*manager, gAddr)), owned(true), writesIssued(0), writesCached(0) {
+	splitAtWrap(*manager, xmAddr, gAddr);
+	invalidate();
+}
+
+Device::Device(I2cManager& shared, uint8_t xmAddr, uint8_t gAddr) :
+		manager(NULL), xm(new I2cBus(shared, xmAddr)), g(new I2cBus(shared, gAddr)),
+		owned(true), writesIssued(0), writesCached(0) {
+	splitAtWrap(shared, xmAddr, gAddr);
+	invalidate();
+}
+
+Device::Device(Bus& xmBus, Bus& gBus) :
+		manager(NULL), xm(&xmBus), g(&gBus), owned(false), writesIssued(0),
+		writesCached(0) {
+	invalidate();
+}
+
+Device::~Device() {
+	if (owned) {
+		delete xm;
+		delete g;
+	}
+	delete manager; // only set when the Device opened the bus itself
+}
+
+void Device::invalidate() {
+	memset(valid, 0, sizeof(valid));
+}
+
+bool Device::writeCached(Chip chip, uint8_t addr, uint8_t value) {
+	if (valid[chip][addr] && cache[chip][addr] == value) {
+		writesCached++;
+		return true;
+	}
+	if (!bus(chip).writeReg(addr, value)) {
+		valid[chip][addr] = false; // the register may or may not have changed
+		return false;
+	}
+	cache[chip][addr] = value;
+	valid[chip][addr] = true;
+	writesIssued++;
+	return true;
+}
+
+bool Device::cachedValue(Chip chip, uint8_t addr, uint8_t& value) {
+	if (!valid[chip][addr]) {
+		uint8_t buf;
+		if (bus(chip).readBytes(addr, &buf, 1) != 1)
+			return false;
+		cache[chip][addr] = buf;
+		valid[chip][addr] = true;
+	}
+	value = cache[chip][addr];
+	return true;
+}
+
+bool Device::configure(const Config& config) {
+	bool ok = true;
+	ok &= write(reg::CTRL_REG0_XM, config.ctrl0XM);
+	ok &= write(reg::CTRL_REG1_XM, config.ctrl1XM);
+	ok &= write(reg::CTRL_REG2_XM, config.ctrl2XM);
+	ok &= write(reg::CTRL_REG5_XM, config.ctrl5XM);
+	ok &= write(reg::CTRL_REG6_XM, config.ctrl6XM);
+	ok &= write(reg::CTRL_REG7_XM, config.ctrl7XM);
+	ok &= write(reg::CTRL_REG2_G, config.ctrl2G);
+	ok &= write(reg::CTRL_REG3_G, config.ctrl3G);
+	ok &= write(reg::CTRL_REG4_G, config.ctrl4G);
+	ok &= write(reg::CTRL_REG5_G, config.ctrl5G);
+	ok &= write(reg::CTRL_REG1_G, config.ctrl1G); // last: powers the gyro up configured
+	return ok;
+}
+
+bool mean(const Block& block, Vector& out) {
+	int32_t x = 0, y = 0, z = 0;
+	if (block.count == 0)
+		return false;
+	for (int i = 0; i < block.count; i++) {
+		x += block.samples[i].v.x;
+		y += block.samples[i].v.y;
+		z += block.samples[i].v.z;
+	}
+	out.x = x / block.count;
+	out.y = y / block.count;
+	out.z = z / block.count;
+	return true;
+}
+
+float accelRate(uint8_t ctrl1XM) {
+	static const float rates[] = { 0, 3.125f, 6.25f, 12.5f, 25, 50, 100, 200, 400, 800, 1600 };
+	unsigned int code = ctrl1XM >> 4;
+	return code < sizeof(rates) / sizeof(rates[0]) ? rates[code] : 0;
+}
+
+float gyroRate(uint8_t ctrl1G) {
+	static const float rates[] = { 95, 190, 380, 760 };
+	return (ctrl1G & 0x08) ? rates[ctrl1G >> 6] : 0; // PD bit clear: powered down
+}
+
+float gyroSensitivity(uint8_t ctrl4G) {
+	static const float dps[] = { 0.00875f, 0.0175f, 0.070f, 0.070f }; // 245, 500, 2000 dps
+	return dps[(ctrl4G >> 4) & 0x03];
+}
+
+bool Device::readAccel(Vector& out) {
+	return readAxes(*xm, reg::OUT_X_L_A.addr, out);
+}
+
+bool Device::readGyro(Vector& out) {
+	return readAxes(*g, reg::OUT_X_L_G.addr, out);
+}
+
+bool Device::readMag(Vector& out) {
+	return readAxes(*xm, reg::OUT_X_L_M.addr, out);
+}
+
+bool Device::readTemp(float& celsius) {
+	return lsm9ds0::readTemp(*xm, reg::OUT_TEMP_L_XM.addr, celsius);
+}
+
+FifoStream::FifoStream(Device& device, int level) : imu(device), watermark(level) {
+	if (watermark < 1)
+		watermark = 1;
+	if (watermark > FIFO_DEPTH - 1)
+		watermark = FIFO_DEPTH - 1;
+}
+
+bool FifoStream::start() {
+	bool ok = true;
+	ok &= imu.write(reg::FIFO_CTRL_REG, FIFO_MODE_STREAM | watermark);
+	ok &= imu.update(reg::CTRL_REG0_XM, FIFO_EN | WTM_EN, FIFO_EN | WTM_EN);
+	ok &= imu.write(reg::FIFO_CTRL_REG_G, FIFO_MODE_STREAM | watermark);
+	ok &= imu.update(reg::CTRL_REG5_G, FIFO_EN_G, FIFO_EN_G);
+	return ok;
+}
+
+bool FifoStream::stop() {
+	bool ok = true;
+	ok &= imu.update(reg::CTRL_REG0_XM, FIFO_EN | WTM_EN, 0);
+	ok &= imu.write(reg::FIFO_CTRL_REG, FIFO_MODE_BYPASS);
+	ok &= imu.update(reg::CTRL_REG5_G, FIFO_EN_G, 0);
+	ok &= imu.write(reg::FIFO_CTRL_REG_G, FIFO_MODE_BYPASS);
+	return ok;
+}
+
+bool FifoStream::drain(Chip chip, bool flush, Block& out) {
+	Bus& bus = imu.bus(chip);
+	uint8_t srcReg = chip == XM ? reg::FIFO_SRC_REG.addr : reg::FIFO_SRC_REG_G.addr;
+	uint8_t outReg = chip == XM ? reg::OUT_X_L_A.addr : reg::OUT_X_L_G.addr;
+	float rate = chip == XM ? accelRate(imu.cached(reg::CTRL_REG1_XM))
+			: gyroRate(imu.cached(reg::CTRL_REG1_G));
+	uint8_t src, buf[FIFO_DEPTH * 6];
+	struct timespec now;
+	uint64_t nowNs, periodNs;
+	int i;
+
+	out.count = 0;
+	out.overrun = false;
+	if (bus.readBytes(srcReg, &src, 1) != 1)
+		return false;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if ((src & FIFO_SRC_EMPTY) || (!(src & FIFO_SRC_WTM) && !flush))
+		return true;
+
+	out.overrun = (src & FIFO_SRC_OVRN) != 0;
+	out.count = out.overrun ? FIFO_DEPTH : (src & FIFO_SRC_FSS);
+	if (out.count == 0)
+		return true;
+
+	// with the FIFO on, auto-increment wraps from Z high back to X low, so one burst
+	// reads every stored sample in turn
+	if (bus.readBytes(outReg | AUTO_INCREMENT, buf, out.count * 6) != out.count * 6) {
+		out.count = 0;
+		return false;
+	}
+
+	// the newest sample was taken at most one period before the check
+	nowNs = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+	periodNs = rate > 0 ? (uint64_t) (1e9f / rate) : 0;
+	for (i = 0; i < out.count; i++) {
+		const uint8_t* b = buf + i * 6;
+		out.samples[i].tNs = nowNs - (uint64_t) (out.count - 1 - i) * periodNs;
+		out.samples[i].v = toVector(b);
+	}
+	return true;
+}
+
+bool FifoStream::poll(Block& accel, Block& gyro, bool flush) {
+	bool ok = drain(XM, flush, accel);
+	return drain(G, flush, gyro) && ok;
+}
+
+} // namespace lsm9ds0
@@ -0,0 +1,471 @@
+/**
+ * @file
+ * @brief Driver for the LSM9DS0 9-degrees of freedom sensor over I2C. The sensor is
+ * two devices on the bus: the accelerometer/magnetometer (XM, which also holds the
+ * temperature sensor) and the gyroscope (G).
+ *
+ * Registers are typed by the device they belong to, so an XM register can't be
+ * written to the gyro by mistake, and the whole map is constexpr. A Device applies one
+ * complete configuration when it starts and keeps a copy of every register it has
+ * written; writes that wouldn't change a register are skipped, so steady-state
+ * sampling does no I2C writes at all.
+ *
+ * The low and high bytes of all three axes are fetched in one auto-incrementing
+ * burst (the sub-address MSB set), so one sample costs one bus transaction instead
+ * of six and the bytes of every axis come from the same sample.
+ *
+ * For full-rate data the accelerometer and gyro FIFOs can be streamed: a FifoStream
+ * lets each FIFO fill to a watermark and then empties it in a single burst, handing
+ * back a block of timestamped samples.
+ *
+ * The chips are reached through a Bus (see imu_bus.hpp): the I2C bus on the Edison,
+ * or a simulated register file for running off-device.
+ *
+ * e.g.: lsm9ds0::Device imu;
+ * 		 imu.configure(lsm9ds0::Config());
+ * 		 lsm9ds0::Vector accel;
+ * 		 if (imu.readAccel(accel))
+ * 		 	... accel.x, accel.y, accel.z ...
+ */
+
+#ifndef LSM9DS0_HPP_
+#define LSM9DS0_HPP_
+
+#include <stdint.h>
+#include "imu_bus.hpp"
+
+namespace lsm9ds0 {
+
+/**
+ * I2C addresses of the two devices on the SparkFun 9DOF block
+ */
+const uint8_t XM_ADDR = 0x1D;
+const uint8_t G_ADDR = 0x6B;
+
+/**
+ * Sub-address bit asking the device to step to the next register after each byte
+ */
+const uint8_t AUTO_INCREMENT = 0x80;
+
+/**
+ * The two devices in the package
+ */
+enum Chip {
+	XM = 0,
+	G = 1
+};
+
+/**
+ * A register of one of the devices.
+ */
+template <Chip C>
+struct Reg {
+	uint8_t addr;
+	constexpr explicit Reg(uint8_t a) : addr(a) {}
+};
+
+typedef Reg<XM> XmReg;
+typedef Reg<G> GReg;
+
+/**
+ * Register map (only the registers this driver uses)
+ */
+namespace reg {
+// accelerometer/magnetometer/temperature
+constexpr XmReg OUT_TEMP_L_XM(0x05);
+constexpr XmReg OUT_X_L_M(0x08);
+constexpr XmReg CTRL_REG0_XM(0x1F);
+constexpr XmReg CTRL_REG1_XM(0x20);
+constexpr XmReg CTRL_REG2_XM(0x21);
+constexpr XmReg CTRL_REG3_XM(0x22);
+constexpr XmReg CTRL_REG4_XM(0x23);
+constexpr XmReg CTRL_REG5_XM(0x24);
+constexpr XmReg CTRL_REG6_XM(0x25);
+constexpr XmReg CTRL_REG7_XM(0x26);
+constexpr XmReg STATUS_REG_A(0x27);
+constexpr XmReg OUT_X_L_A(0x28);
+constexpr XmReg FIFO_CTRL_REG(0x2E);
+constexpr XmReg FIFO_SRC_REG(0x2F);
+
+// gyroscope
+constexpr GReg CTRL_REG1_G(0x20);
+constexpr GReg CTRL_REG2_G(0x21);
+constexpr GReg CTRL_REG3_G(0x22);
+constexpr GReg CTRL_REG4_G(0x23);
+constexpr GReg CTRL_REG5_G(0x24);
+constexpr GReg STATUS_REG_G(0x27);
+constexpr GReg OUT_X_L_G(0x28);
+constexpr GReg FIFO_CTRL_REG_G(0x2E);
+constexpr GReg FIFO_SRC_REG_G(0x2F);
+} // namespace reg
+
+/**
+ * Register bits used by the FIFO stream
+ * 		FIFO_EN, WTM_EN			CTRL_REG0_XM: accelerometer FIFO and watermark enable
+ * 		FIFO_EN_G				CTRL_REG5_G: gyro FIFO enable
+ * 		FIFO_MODE_*				FIFO_CTRL_REG(_G) bits 7-5, watermark level in bits 4-0
+ * 		FIFO_SRC_*				FIFO_SRC_REG(_G): watermark reached, overrun, empty and
+ * 								the number of stored samples
+ */
+const uint8_t FIFO_EN = 0x40;
+const uint8_t WTM_EN = 0x20;
+const uint8_t FIFO_EN_G = 0x40;
+const uint8_t FIFO_MODE_BYPASS = 0x00;
+const uint8_t FIFO_MODE_STREAM = 0x40;
+const uint8_t FIFO_MODE_MASK = 0xE0;
+const uint8_t FIFO_SRC_WTM = 0x80;
+const uint8_t FIFO_SRC_OVRN = 0x40;
+const uint8_t FIFO_SRC_EMPTY = 0x20;
+const uint8_t FIFO_SRC_FSS = 0x1F;
+
+/**
+ * Register bits used for data-ready sampling
+ * 		P1_DRDYA				CTRL_REG3_XM: accelerometer data ready on INT1_XM
+ * 		I2_DRDY					CTRL_REG3_G: gyro data ready on DRDY_G
+ * 		STATUS_ZYXDA			STATUS_REG_A/_G: a new X/Y/Z sample is available
+ * 		STATUS_ZYXOR			STATUS_REG_A/_G: a sample was overwritten before it was read
+ */
+const uint8_t P1_DRDYA = 0x04;
+const uint8_t I2_DRDY = 0x08;
+const uint8_t STATUS_ZYXDA = 0x08;
+const uint8_t STATUS_ZYXOR = 0x80;
+
+/**
+ * Size of each device's register space (sub-addresses are 7 bits)
+ */
+const int REGISTERS = 0x80;
+
+/**
+ * Complete configuration of both devices. The defaults are the settings the labs
+ * have always used:
+ * 		ctrl0XM	0x00	FIFO off
+ * 		ctrl1XM	0x47	Accelerometer at 25 Hz, X/Y/Z enabled
+ * 		ctrl2XM	0xC0	Accelerometer anti-alias filter 50 Hz, +-2g
+ * 		ctrl5XM	0x98	Temperature sensor on, magnetometer at 50 Hz, low resolution
+ * 		ctrl6XM	0x20	Magnetometer +-4 gauss
+ * 		ctrl7XM	0x00	Magnetometer continuous conversion
+ * 		ctrl1G	0x0F	Gyroscope at 95 Hz, normal mode, X/Y/Z enabled
+ * 		ctrl2G-ctrl5G	0x00	Gyroscope filters and interrupts off, 245 dps
+ */
+struct Config {
+	uint8_t ctrl0XM = 0x00;
+	uint8_t ctrl1XM = 0x47;
+	uint8_t ctrl2XM = 0xC0;
+	uint8_t ctrl5XM = 0x98;
+	uint8_t ctrl6XM = 0x20;
+	uint8_t ctrl7XM = 0x00;
+	uint8_t ctrl1G = 0x0F;
+	uint8_t ctrl2G = 0x00;
+	uint8_t ctrl3G = 0x00;
+	uint8_t ctrl4G = 0x00;
+	uint8_t ctrl5G = 0x00;
+};
+
+/**
+ * One sample of the three axes of a sensor
+ */
+struct Vector {
+	int16_t x, y, z;
+};
+
+/**
+ * A sample with the time it was taken (CLOCK_MONOTONIC, nanoseconds)
+ */
+struct Sample {
+	uint64_t tNs;
+	Vector v;
+};
+
+/**
+ * Samples drained from one FIFO in one burst, oldest first.
+ * 		count	Number of samples
+ * 		overrun	Whether the FIFO had filled up and older samples were lost
+ */
+struct Block {
+	int count;
+	bool overrun;
+	Sample samples[FIFO_DEPTH];
+};
+
+/**
+ * Average of the samples in a block.
+ *
+ * @param block The samples
+ * @param out Filled in with the average of each axis (left alone if the block is empty)
+ *
+ * @return false if the block is empty
+ */
+bool mean(const Block& block, Vector& out);
+
+/**
+ * Output data rate set by a control register value, in Hz
+ *
+ * @param ctrl1XM Value of CTRL_REG1_XM (accelerometer rate in bits 7-4)
+ *
+ * @return The accelerometer rate, or 0 when powered down
+ */
+float accelRate(uint8_t ctrl1XM);
+
+/**
+ * @param ctrl1G Value of CTRL_REG1_G (gyro rate in bits 7-6)
+ *
+ * @return The gyro rate, or 0 when powered down
+ */
+float gyroRate(uint8_t ctrl1G);
+
+/**
+ * Gyro sensitivity set by a control register value
+ *
+ * @param ctrl4G Value of CTRL_REG4_G (full scale in bits 5-4)
+ *
+ * @return Degrees per second per count
+ */
+float gyroSensitivity(uint8_t ctrl4G);
+
+/**
+ * Takes two unsigned 8-bit integers (a low and high) and converts them into one
+ * 16-bit signed integer.
+ *
+ * @param low The lower 8 bits
+ * @param hi The upper 8 bits
+ *
+ * @return The combined 16-bit signed integer
+ */
+int16_t assemble(uint8_t low, uint8_t hi);
+
+/**
+ * Takes two unsigned 8-bit integers (a low and high) and converts them into one
+ * 12-bit signed integer.
+ *
+ * @param low The lower 8 bits
+ * @param hi The upper 4 bits
+ *
+ * @return The combined 12-bit signed integer
+ */
+int16_t assemble12(uint8_t low, uint8_t hi);
+
+/**
+ * Converts the six output registers of a sensor (X low through Z high) to a sample.
+ *
+ * @param buf The registers
+ *
+ * @return The sample
+ */
+Vector toVector(const uint8_t* buf);
+
+/**
+ * Converts the two temperature registers (low, high) to degrees C.
+ *
+ * @param buf The registers
+ *
+ * @return The temperature in C
+ */
+float toCelsius(const uint8_t* buf);
+
+/**
+ * Reads the six output registers of a sensor (X low through Z high) in one burst.
+ *
+ * @param bus The chip of the sensor
+ * @param reg The X low output register
+ * @param out Filled in with the sample
+ *
+ * @return true if all six bytes were read
+ */
+bool readAxes(Bus& bus, uint8_t reg, Vector& out);
+
+/**
+ * Reads the two temperature registers in one burst.
+ *
+ * @param bus The accelerometer/magnetometer chip
+ * @param reg The temperature low output register
+ * @param celsius Filled in with the temperature in C
+ *
+ * @return true if both bytes were read
+ */
+bool readTemp(Bus& bus, uint8_t reg, float& celsius);
+
+/**
+ * Both devices of one LSM9DS0 with a cache of the registers written to them.
+ */
+class Device {
+public:
+	/**
+	 * Opens both devices on a bus of their own. Nothing is written until configure().
+	 *
+	 * @param bus The I2C bus the sensor is on
+	 * @param xmAddr Address of the accelerometer/magnetometer
+	 * @param gAddr Address of the gyroscope
+	 */
+	Device(int bus = 1, uint8_t xmAddr = XM_ADDR, uint8_t gAddr = G_ADDR);
+
+	/**
+	 * Opens both devices on a bus shared with other devices, which must outlive the
+	 * Device.
+	 *
+	 * @param manager The bus the sensor is on
+	 * @param xmAddr Address of the accelerometer/magnetometer
+	 * @param gAddr Address of the gyroscope
+	 */
+	Device(I2cManager& manager, uint8_t xmAddr = XM_ADDR, uint8_t gAddr = G_ADDR);
+
+	/**
+	 * Uses chips the caller provides (e.g. SimBus), which must outlive the Device.
+	 *
+	 * @param xm The accelerometer/magnetometer
+	 * @param g The gyroscope
+	 */
+	Device(Bus& xm, Bus& g);
+
+	~Device();
+
+	Device(const Device&) = delete;
+	Device& operator=(const Device&) = delete;
+
+	/**
+	 * Applies a complete configuration. Registers already holding the value are
+	 * not written.
+	 *
+	 * @param config The configuration
+	 *
+	 * @return true if every write succeeded
+	 */
+	bool configure(const Config& config);
+
+	/**
+	 * Writes a register unless the cache shows it already holds the value.
+	 *
+	 * @param r The register
+	 * @param value The value to write
+	 *
+	 * @return true if the register holds the value
+	 */
+	template <Chip C>
+	bool write(Reg<C> r, uint8_t value) {
+		return writeCached(C, r.addr, value);
+	}
+
+	/**
+	 * Changes some bits of a register, reading it first if it isn't cached.
+	 *
+	 * @param r The register
+	 * @param mask The bits to change
+	 * @param bits Their new values
+	 *
+	 * @return true if the register holds the new value
+	 */
+	template <Chip C>
+	bool update(Reg<C> r, uint8_t mask, uint8_t bits) {
+		uint8_t value;
+		if (!cachedValue(C, r.addr, value))
+			return false;
+		return writeCached(C, r.addr, (value & ~mask) | (bits & mask));
+	}
+
+	/**
+	 * Value of a register as last written or read, or 0 if it is unknown
+	 */
+	template <Chip C>
+	uint8_t cached(Reg<C> r) const {
+		return valid[C][r.addr] ? cache[C][r.addr] : 0;
+	}
+
+	/**
+	 * Forgets the cached value of every register, so the next configure() writes
+	 * them all (e.g. after the sensor has been power cycled).
+	 */
+	void invalidate();
+
+	/**
+	 * Reads one sample of a sensor in a single burst.
+	 *
+	 * @param out Filled in with the sample (the temperature in C for readTemp)
+	 *
+	 * @return true if the read succeeded
+	 */
+	bool readAccel(Vector& out);
+	bool readGyro(Vector& out);
+	bool readMag(Vector& out);
+	bool readTemp(float& celsius);
+
+	/**
+	 * Bus of each chip, for reads the driver doesn't wrap
+	 */
+	Bus& bus(Chip chip) {
+		return chip == XM ? *xm : *g;
+	}
+
+	/**
+	 * Register writes issued, and writes skipped because the value was cached
+	 */
+	unsigned long writes() const {
+		return writesIssued;
+	}
+	unsigned long writesSkipped() const {
+		return writesCached;
+	}
+
+private:
+	bool writeCached(Chip chip, uint8_t addr, uint8_t value);
+	bool cachedValue(Chip chip, uint8_t addr, uint8_t& value);
+
+	I2cManager* manager;
+	Bus* xm;
+	Bus* g;
+	bool owned;
+	uint8_t cache[2][REGISTERS];
+	bool valid[2][REGISTERS];
+	unsigned long writesIssued;
+	unsigned long writesCached;
+};
+
+/**
+ * Streams the accelerometer and gyro through their FIFOs. Each FIFO runs in stream
+ * mode (the oldest sample is dropped when full) and is emptied in one burst once it
+ * reaches the watermark, so a sample costs a fraction of a bus transaction. Sample
+ * times are worked back from the time the FIFO was checked at the output data rate.
+ */
+class FifoStream {
+public:
+	/**
+	 * @param imu The configured sensor
+	 * @param watermark Samples to collect before a FIFO is emptied (1 to FIFO_DEPTH - 1)
+	 */
+	FifoStream(Device& imu, int watermark = FIFO_DEPTH / 2);
+
+	/**
+	 * Enables both FIFOs in stream mode.
+	 *
+	 * @return true if every register was written
+	 */
+	bool start();
+
+	/**
+	 * Puts both FIFOs back in bypass mode, returning the output registers to single
+	 * samples.
+	 *
+	 * @return true if every register was written
+	 */
+	bool stop();
+
+	/**
+	 * Checks both FIFOs and empties any that reached the watermark (or holds any
+	 * samples when flush is set).
+	 *
+	 * @param accel Filled in with the accelerometer samples drained
+	 * @param gyro Filled in with the gyro samples drained
+	 * @param flush Empty the FIFOs even below the watermark
+	 *
+	 * @return false if a bus transaction failed
+	 */
+	bool poll(Block& accel, Block& gyro, bool flush = false);
+
+private:
+	bool drain(Chip chip, bool flush, Block& out);
+
+	Device& imu;
+	int watermark;
+};
+
+} // namespace lsm9ds0
+
+#endif /* LSM9DS0_HPP_ */
@@ -1,70 +1,445 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
 #include "button.h"
+#include "button_state.h"
+#include "button_lines.h"
 
-struct button_context * button_init(int pin, void (*args)()){
+/*
+ * Current time in microseconds from the monotonic clock.
+ */
+static uint64_t now_us(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+/*
+ * Line set shared by every button read through the GPIO character device. It is
+ * opened by the first button and closed with the last; lines_open is -1 once opening
+ * has failed, after which buttons use MRAA. The latest read is kept so buttons
+ * sampling at about the same time share it.
+ */
+static struct button_lines lines;
+static int lines_open, lines_users;
+static uint8_t lines_raw;
+static uint64_t lines_read_us;
+static pthread_mutex_t lines_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Take a reference on the shared line set for one of the block's buttons.
+ *
+ * @return 0 if the button can be read from the line set, -1 to use MRAA
+ */
+static int lines_acquire(int pin) {
+	int result = -1;
+	if (button_pin_bit(pin) == 0)
+		return -1;
+	pthread_mutex_lock(&lines_lock);
+	if (lines_open == 0)
+		lines_open = button_lines_open_all(&lines) == 0 ? 1 : -1;
+	if (lines_open == 1) {
+		lines_users++;
+		result = 0;
+	}
+	pthread_mutex_unlock(&lines_lock);
+	return result;
+}
+
+static void lines_release(void) {
+	pthread_mutex_lock(&lines_lock);
+	if (--lines_users == 0) {
+		button_lines_close(&lines);
+		lines_open = 0;
+		lines_read_us = 0;
+	}
+	pthread_mutex_unlock(&lines_lock);
+}
+
+/*
+ * Read a button's pin, 1 when released and 0 when pressed like mraa_gpio_read(), or
+ * -1 if the read failed.
+ */
+static int pin_read(struct button_context * context, uint64_t now) {
+	int value = 1;
+	if (context->gpio_button_context != NULL)
+		return mraa_gpio_read(context->gpio_button_context);
+	pthread_mutex_lock(&lines_lock);
+	if (lines_read_us == 0 || now - lines_read_us >= BUTTON_SCAN_SHARE_US) {
+		if (button_lines_read(&lines, &lines_raw) < 0)
+			value = -1;
+		else
+			lines_read_us = now;
+	}
+	if (value == 1 && (lines_raw & context->mask_bit))
+		value = 0;
+	pthread_mutex_unlock(&lines_lock);
+	return value;
+}
+
+#ifdef BUTTON_STATIC_POOL
+/*
+ * Storage for BUTTON_STATIC_POOL builds: every context, watcher thread, thread stack
+ * and calibration buffer comes from these arrays, so nothing is allocated after
+ * startup.
+ */
+struct button_slot {
+	struct button_context context;
+	pthread_t thread;
+	uint8_t used;
+	union {
+		struct button_calib calib;
+		unsigned char bytes[sizeof(struct button_calib) + BUTTON_CALIB_BURSTS * sizeof(unsigned int)];
+	} calib;
+};
+
+static struct button_slot slots[BUTTON_POOL_SIZE];
+static char stacks[BUTTON_POOL_SIZE][BUTTON_STACK_SIZE] __attribute__((aligned(16)));
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
 
-	struct button_context * button_action = (struct button_context *)calloc(1, sizeof(struct button_context));
+static struct button_slot * slot_of(struct button_context * context) {
+	return (struct button_slot *) ((char *) context - offsetof(struct button_slot, context));
+}
 
-	button_action->gpio_button_context = mraa_gpio_init_raw(pin);
-	if (mraa_gpio_dir(button_action->gpio_button_context, MRAA_GPIO_IN) != MRAA_SUCCESS)
+static struct button_context * context_alloc(void) {
+	int i;
+	pthread_mutex_lock(&slots_lock);
+	for (i = 0; i < BUTTON_POOL_SIZE; i++) {
+		if (!slots[i].used) {
+			memset(&slots[i].context, 0, sizeof(slots[i].context));
+			slots[i].used = 1;
+			slots[i].context.thread = &slots[i].thread;
+			pthread_mutex_unlock(&slots_lock);
+			return &slots[i].context;
+		}
+	}
+	pthread_mutex_unlock(&slots_lock);
+	return NULL;
+}
+
+static void context_free(struct button_context * context) {
+	pthread_mutex_lock(&slots_lock);
+	slot_of(context)->used = 0;
+	pthread_mutex_unlock(&slots_lock);
+}
+
+static int thread_start(struct button_context * context) {
+	pthread_attr_t attr;
+	int result;
+	pthread_attr_init(&attr);
+	pthread_attr_setstack(&attr, stacks[slot_of(context) - slots], BUTTON_STACK_SIZE);
+	result = pthread_create(context->thread, &attr, &buttonThread, context);
+	pthread_attr_destroy(&attr);
+	return result;
+}
+
+static struct button_calib * calib_alloc(struct button_context * context, unsigned int bursts) {
+	struct button_calib * calib = &slot_of(context)->calib.calib;
+	memset(calib, 0, sizeof(slot_of(context)->calib));
+	calib->capacity = bursts < BUTTON_CALIB_BURSTS ? bursts : BUTTON_CALIB_BURSTS;
+	return calib;
+}
+
+static void calib_free(struct button_context * context, struct button_calib * calib) {
+	// the buffer belongs to the slot and is reused by the next calibration
+}
+#else
+static struct button_context * context_alloc(void) {
+	struct button_context * context = (struct button_context *)calloc(1, sizeof(struct button_context));
+	if (context != NULL) {
+		//button_action->thread = calloc(1, sizeof(pthread_t));
+		context->thread = (pthread_t *)calloc(1, sizeof(pthread_t));
+		if (context->thread == NULL) {
+			free(context);
+			context = NULL;
+		}
+	}
+	return context;
+}
+
+static void context_free(struct button_context * context) {
+	free(context->thread);
+	free(context);
+}
+
+static int thread_start(struct button_context * context) {
+	return pthread_create(context->thread, NULL, &buttonThread, context);
+}
+
+static struct button_calib * calib_alloc(struct button_context * context, unsigned int bursts) {
+	struct button_calib * calib = (struct button_calib *)calloc(1, sizeof(struct button_calib)
+			+ bursts * sizeof(unsigned int));
+	if (calib != NULL)
+		calib->capacity = bursts;
+	return calib;
+}
+
+static void calib_free(struct button_context * context, struct button_calib * calib) {
+	free(calib);
+}
+#endif
+
+struct button_context * button_init(int pin, void (*args)()){
+
+	struct button_context * button_action = context_alloc();
+	if (button_action == NULL)
 	{
-		fprintf(stderr, "Coulnd't initialize GPIO on pin %d, exiting", pin);
+		fprintf(stderr, "Couldn't allocate a button for pin %d, exiting", pin);
 		exit(MRAA_ERROR_UNSPECIFIED);
 	}
 
+	// read from the shared line set when the character device is there
+	button_action->gpio_button_context = NULL;
+	if (lines_acquire(pin) < 0) {
+		button_action->gpio_button_context = mraa_gpio_init_raw(pin);
+		if (mraa_gpio_dir(button_action->gpio_button_context, MRAA_GPIO_IN) != MRAA_SUCCESS)
+		{
+			fprintf(stderr, "Coulnd't initialize GPIO on pin %d, exiting", pin);
+			exit(MRAA_ERROR_UNSPECIFIED);
+		}
+	}
+
 	button_action->action = args;
 	button_action->bits = 1;
+	button_action->mask_bit = button_pin_bit(pin);
+	button_action->press_threshold = PRESS_THRESHOLD;
+	button_action->release_threshold = RELEASE_THRESHOLD;
 	button_action->endFlag = 0;
-	//button_action->thread = calloc(1, sizeof(pthread_t));
-	button_action->thread = (pthread_t *)calloc(1, sizeof(pthread_t));
+	button_action->passes = 0;
+	button_action->poll_fast_us = BUTTON_POLL_FAST_US;
+	button_action->poll_idle_us = BUTTON_POLL_IDLE_US;
+	button_action->poll_start_us = now_us();
+	button_action->dispatch = BUTTON_DISPATCH_INLINE;
 
-	pthread_create(button_action->thread, NULL, &buttonThread, button_action);
+	if (thread_start(button_action) != 0)
+	{
+		fprintf(stderr, "Couldn't start the thread for pin %d, exiting", pin);
+		exit(MRAA_ERROR_UNSPECIFIED);
+	}
 	return button_action;
 }
 
+uint8_t button_pin_bit(int pin){
+	switch (pin) {
+	case PIN_A:			return BUTTON_BIT_A;
+	case PIN_B:			return BUTTON_BIT_B;
+	case PIN_UP:		return BUTTON_BIT_UP;
+	case PIN_DOWN:		return BUTTON_BIT_DOWN;
+	case PIN_LEFT:		return BUTTON_BIT_LEFT;
+	case PIN_RIGHT:		return BUTTON_BIT_RIGHT;
+	case PIN_SELECT:	return BUTTON_BIT_SELECT;
+	default:			return 0;
+	}
+}
+
 void * buttonThread(void * args) {
 	int value;
 	struct button_context * context = (struct button_context*) args; // cast the argument
 	uint8_t shiftReg = 0xFF;
-	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS,NULL);
-	for (;;) {
-		
-		if(context->endFlag == 1){
-			pthread_exit((void *)1);
+	unsigned int fast_us, idle_us; // poll rates, which button_set_poll_rate() can change
+	unsigned int interval = __atomic_load_n(&context->poll_fast_us, __ATOMIC_RELAXED);
+	unsigned int stable = 0; // samples since the pin last changed
+	uint64_t now, last = now_us(); // time of this and the previous sample
+	uint64_t changed = 0; // last sample that still saw the old state, 0 if none pending
+	struct button_calib * calib;
+	while (__atomic_load_n(&context->endFlag, __ATOMIC_ACQUIRE) == 0) {
+		now = now_us();
+		value = pin_read(context, now);
+		if (value < 0) {
+			// the read failed: skip the sample rather than feed the debouncer a press
+			__atomic_add_fetch(&context->passes, 1, __ATOMIC_SEQ_CST);
+			usleep(interval);
+			continue;
+		}
+		fast_us = __atomic_load_n(&context->poll_fast_us, __ATOMIC_RELAXED);
+		idle_us = __atomic_load_n(&context->poll_idle_us, __ATOMIC_RELAXED);
+
+		__atomic_add_fetch(&context->poll.wakeups, 1, __ATOMIC_RELAXED);
+		if (interval > fast_us) {
+			__atomic_add_fetch(&context->poll.idle_wakeups, 1, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&context->poll_idle_time_us, now - last, __ATOMIC_RELAXED);
+		}
+
+		calib = __atomic_load_n(&context->calib, __ATOMIC_ACQUIRE);
+		if (calib != NULL) {
+			// time the bounces at the fast rate, not wherever the back-off had got to
+			button_calib_record(calib, value, now);
+			interval = fast_us;
+			stable = 0;
 		}
-		value = mraa_gpio_read(context->gpio_button_context);
 
 		shiftReg >>= 1;
 
 		if (value == 1) {
 			shiftReg |= BIT_MASK;
 		}
+
+		if ((value == 1) != (context->bits == 1)) {
+			// pin disagrees with the debounced state: sample fast until it settles
+			if (changed == 0)
+				changed = last;
+			interval = fast_us;
+			stable = 0;
+		} else if (shiftReg == 0x00 || shiftReg == 0xFF) {
+			// settled; back off once the button has been quiet for a while
+			if (++stable >= BUTTON_POLL_SETTLE && interval < idle_us) {
+				interval *= 2;
+				if (interval > idle_us)
+					interval = idle_us;
+			}
+			changed = 0; // a glitch that never made it through the debounce
+		}
+
 		if (context->bits == 0) {
-			if (shiftReg >= RELEASE_THRESHOLD) {
+			if (shiftReg >= context->release_threshold) {
 				//Button has been released.
 				context->bits = 1;
+				buttons_publish(0, context->mask_bit);
 			}
 		} else {
-			if (shiftReg <= PRESS_THRESHOLD) {
+			if (shiftReg <= context->press_threshold) {
 				//Button has been pressed.
-				context->action();
+				void (*action)() = __atomic_load_n(&context->action, __ATOMIC_ACQUIRE);
+				if (action != NULL)
+					button_dispatch_action(context, action);
 				context->bits = 0;
+				buttons_publish(context->mask_bit, 0);
 			}
 		}
-		usleep(500);
+
+		if (changed != 0 && (value == 1) == (context->bits == 1)) {
+			// debounced state caught up with the pin: record how long it took
+			unsigned int delay = (unsigned int) (now - changed);
+			__atomic_store_n(&context->poll.last_detect_us, delay, __ATOMIC_RELAXED);
+			if (delay > __atomic_load_n(&context->poll.worst_detect_us, __ATOMIC_RELAXED))
+				__atomic_store_n(&context->poll.worst_detect_us, delay, __ATOMIC_RELAXED);
+			changed = 0;
+		}
+
+		// end of a pass: no callback is running, so old ones can be reclaimed
+		__atomic_add_fetch(&context->passes, 1, __ATOMIC_SEQ_CST);
+		last = now;
+		usleep(interval);
+	}
+	return NULL;
+}
+
+void button_update_function(struct button_context * context, void (*args)()){
+	__atomic_store_n(&context->action, args, __ATOMIC_RELEASE);
+}
+
+void button_synchronize(struct button_context * context){
+	uint32_t start;
+
+	// the callback is waiting on itself; nothing older can be running
+	if (pthread_equal(pthread_self(), *context->thread))
+		return;
+
+	if (context->dispatch != BUTTON_DISPATCH_INLINE)
+		button_pool_drain(context);
+
+	// two full passes: one to finish a callback in flight, one so any pass that read
+	// the old pointer just before it was replaced has completed as well
+	start = __atomic_load_n(&context->passes, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&context->passes, __ATOMIC_SEQ_CST) - start < 2) {
+		if (__atomic_load_n(&context->endFlag, __ATOMIC_ACQUIRE) == 1)
+			return;
+		usleep(100);
 	}
+}
 
+void button_set_poll_rate(struct button_context * context, unsigned int fast_us, unsigned int idle_us){
+	if (fast_us == 0)
+		fast_us = 1;
+	if (idle_us < fast_us)
+		idle_us = fast_us;
+	__atomic_store_n(&context->poll_fast_us, fast_us, __ATOMIC_RELAXED);
+	__atomic_store_n(&context->poll_idle_us, idle_us, __ATOMIC_RELAXED);
 }
 
-void button_update_function(struct button_context * context, void * args){
-	pthread_create(context->thread, NULL, &buttonThread, args);
+void button_get_poll_stats(struct button_context * context, struct button_poll_stats * stats){
+	uint64_t elapsed = now_us() - context->poll_start_us;
+	uint64_t idle = __atomic_load_n(&context->poll_idle_time_us, __ATOMIC_RELAXED);
+
+	stats->wakeups = __atomic_load_n(&context->poll.wakeups, __ATOMIC_RELAXED);
+	stats->idle_wakeups = __atomic_load_n(&context->poll.idle_wakeups, __ATOMIC_RELAXED);
+	stats->last_detect_us = __atomic_load_n(&context->poll.last_detect_us, __ATOMIC_RELAXED);
+	stats->worst_detect_us = __atomic_load_n(&context->poll.worst_detect_us, __ATOMIC_RELAXED);
+	stats->wakeups_per_sec = elapsed ? stats->wakeups * 1e6f / elapsed : 0;
+	stats->idle_wakeups_per_sec = idle ? stats->idle_wakeups * 1e6f / idle : 0;
+}
+
+void button_set_settle(struct button_context * context, int press, int release){
+	if (press < 1)
+		press = 1;
+	if (press > 8)
+		press = 8;
+	if (release < 1)
+		release = 1;
+	if (release > 8)
+		release = 8;
+	// n samples at the same level fill the top n bits of the shift register
+	context->press_threshold = 0xFF >> press;
+	context->release_threshold = (uint8_t) (0xFF << (8 - release));
+}
+
+int button_calib_start(struct button_context * context, unsigned int bursts){
+	struct button_calib * calib;
+
+	// restarting: drop the old recording once the watcher is past it
+	calib = __atomic_exchange_n(&context->calib, NULL, __ATOMIC_ACQ_REL);
+	if (calib != NULL) {
+		button_synchronize(context);
+		calib_free(context, calib);
+	}
+
+	calib = calib_alloc(context, bursts);
+	if (calib == NULL)
+		return -1;
+	calib->last_value = -1;
+
+	__atomic_store_n(&context->calib, calib, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int button_calib_finish(struct button_context * context, float target,
+		struct button_calibration * result){
+	struct button_calib * calib;
+	unsigned int count;
+
+	calib = __atomic_exchange_n(&context->calib, NULL, __ATOMIC_ACQ_REL);
+	if (calib == NULL)
+		return -1;
+	button_synchronize(context); // the watcher no longer touches calib after this
+
+	count = __atomic_load_n(&calib->count, __ATOMIC_ACQUIRE);
+	if (count == 0) {
+		calib_free(context, calib);
+		return -1;
+	}
+
+	button_calib_estimate(calib->durations, count, target,
+			__atomic_load_n(&context->poll_fast_us, __ATOMIC_RELAXED), result);
+	calib_free(context, calib);
+
+	context->press_threshold = result->press_threshold;
+	context->release_threshold = result->release_threshold;
+	return 0;
 }
 
 void button_close(struct button_context * context){
-	 context->endFlag = 1;
-	 free(context->thread);
-	 mraa_gpio_close(context->gpio_button_context);
+	 __atomic_store_n(&context->endFlag, 1, __ATOMIC_RELEASE);
+	 pthread_join(*context->thread, NULL); // the watcher is done with context after this
+	 button_pool_drain(context); // and so are the workers after this
+	 if (context->calib != NULL)
+		 calib_free(context, context->calib);
+	 if (context->gpio_button_context != NULL)
+		 mraa_gpio_close(context->gpio_button_context);
+	 else
+		 lines_release();
 	 context->action = NULL;
-	 free(context);
+	 context_free(context);
 }
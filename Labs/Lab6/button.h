@@ -14,6 +14,7 @@
 extern "C" {
 #endif
 
+#include <pthread.h>
 #include <mraa.h>
 
 
@@ -28,6 +29,19 @@ extern "C" {
 #define PIN_RIGHT  	45
 #define PIN_SELECT  48
 
+/**
+ * Bit used for each button in a debounced button bitmask. The order matches the
+ * Buttons union used in the labs. A set bit means the button is pressed.
+ */
+#define BUTTON_BIT_A		0x01
+#define BUTTON_BIT_B		0x02
+#define BUTTON_BIT_UP		0x04
+#define BUTTON_BIT_DOWN		0x08
+#define BUTTON_BIT_LEFT		0x10
+#define BUTTON_BIT_RIGHT	0x20
+#define BUTTON_BIT_SELECT	0x40
+#define BUTTON_MASK_ALL		0x7F
+
 /**
  * 8-bit binary value of 1000 0000: Used in the button debouncing as a reset for the
  * button's shift register
@@ -43,19 +57,190 @@ extern "C" {
 #define PRESS_THRESHOLD 	0x3F
 #define RELEASE_THRESHOLD 	0xFC
 
+/**
+ * Build with BUTTON_STATIC_POOL defined to take every button context, watcher thread
+ * stack, worker stack and calibration buffer from static arrays sized here instead
+ * of the heap. Startup and shutdown then do no allocation and cannot fail for lack of
+ * memory; button_init() exits if more than BUTTON_POOL_SIZE buttons are open at once.
+ * 		BUTTON_POOL_SIZE		Buttons that can be open at the same time
+ * 		BUTTON_STACK_SIZE		Stack size of each watcher and worker thread in bytes
+ * 		BUTTON_CALIB_BURSTS		Bounce bursts each button can record while calibrating
+ */
+#ifndef BUTTON_POOL_SIZE
+#define BUTTON_POOL_SIZE		7
+#endif
+#ifndef BUTTON_STACK_SIZE
+#define BUTTON_STACK_SIZE		65536
+#endif
+#ifndef BUTTON_CALIB_BURSTS
+#define BUTTON_CALIB_BURSTS		64
+#endif
+
+/**
+ * Calibration of the debounce thresholds. While calibrating, every burst of raw
+ * edges on a button is timed; a burst ends once the pin has been quiet for
+ * BUTTON_CALIB_GAP_US. BUTTON_CALIB_TARGET is the default acceptable rate of
+ * presses whose bounce outlasts the chosen settle window.
+ */
+#define BUTTON_CALIB_GAP_US		20000
+#define BUTTON_CALIB_TARGET		0.001f
+
+/**
+ * Bounce durations recorded for one button while it is calibrating. The thread
+ * watching the button owns the burst timing; count is published atomically.
+ */
+struct button_calib {
+	unsigned int capacity;
+	unsigned int count;
+	int last_value;
+	uint64_t burst_start_us;
+	uint64_t burst_last_us;
+	unsigned int durations[];
+};
+
+/**
+ * Outcome of a calibration:
+ * 		bursts		Number of bounce bursts measured
+ * 		min_us		Shortest bounce
+ * 		median_us	Median bounce
+ * 		max_us		Longest bounce
+ * 		window_us	Settle window meeting the target false-trigger rate
+ * 		samples		Consecutive samples the window takes at the fast poll rate
+ * 		press_threshold, release_threshold	Thresholds matching samples
+ */
+struct button_calibration {
+	unsigned int bursts;
+	unsigned int min_us;
+	unsigned int median_us;
+	unsigned int max_us;
+	unsigned int window_us;
+	uint8_t samples;
+	uint8_t press_threshold;
+	uint8_t release_threshold;
+};
+
+/**
+ * Default polling intervals in microseconds. Buttons are sampled every
+ * BUTTON_POLL_FAST_US while they are changing or were recently active. Once a
+ * button has been stable for BUTTON_POLL_SETTLE samples the interval doubles on
+ * every pass until it reaches BUTTON_POLL_IDLE_US. Any change seen on the pin goes
+ * straight back to the fast interval.
+ */
+#define BUTTON_POLL_FAST_US		500
+#define BUTTON_POLL_IDLE_US		10000
+#define BUTTON_POLL_SETTLE		64
+
+/**
+ * Buttons are read through the GPIO character device when it can be opened (see
+ * button_lines.h), otherwise one MRAA pin at a time. The character device returns
+ * every button in one read, so a sample taken within BUTTON_SCAN_SHARE_US of the
+ * last read reuses it rather than issuing another.
+ */
+#define BUTTON_SCAN_SHARE_US	250
+
+/**
+ * Counters kept by the thread watching a button to tune the polling trade-off:
+ * 		wakeups					Samples taken since the button was initialized
+ * 		idle_wakeups			Samples taken while backed off to a slower rate
+ * 		wakeups_per_sec			Average sample rate over the button's lifetime
+ * 		idle_wakeups_per_sec	Average sample rate while backed off
+ * 		last_detect_us			Worst-case delay of the most recent press or release
+ * 		worst_detect_us			Largest worst-case delay seen so far
+ * The worst-case delay of a change is measured from the last sample that still saw
+ * the old state to the moment the debounced state flipped.
+ */
+struct button_poll_stats {
+	unsigned long wakeups;
+	unsigned long idle_wakeups;
+	float wakeups_per_sec;
+	float idle_wakeups_per_sec;
+	unsigned int last_detect_us;
+	unsigned int worst_detect_us;
+};
+
+/**
+ * How a button runs its action when pressed:
+ * 		BUTTON_DISPATCH_INLINE		On the thread watching the button (the default);
+ * 									the button is deaf until the action returns
+ * 		BUTTON_DISPATCH_COALESCE	On the worker pool; presses while the action is in
+ * 									flight collapse into one more run afterwards
+ * 		BUTTON_DISPATCH_QUEUE		On the worker pool; every press runs the action,
+ * 									one run at a time (up to BUTTON_QUEUE_DEPTH
+ * 									presses wait behind the one in flight)
+ * 		BUTTON_DISPATCH_DROP		On the worker pool; presses while the action is in
+ * 									flight are ignored
+ */
+enum button_dispatch {
+	BUTTON_DISPATCH_INLINE,
+	BUTTON_DISPATCH_COALESCE,
+	BUTTON_DISPATCH_QUEUE,
+	BUTTON_DISPATCH_DROP
+};
+
+/**
+ * Number of worker threads running pooled button actions, and the number of actions
+ * that can wait for a worker before new presses are dropped.
+ */
+#define BUTTON_WORKERS		2
+#define BUTTON_QUEUE_DEPTH	16
+
+/**
+ * Counters kept by the worker pool:
+ * 		depth		Actions currently waiting for a worker
+ * 		max_depth	Most actions ever waiting at once
+ * 		dispatched	Actions handed to the pool
+ * 		coalesced	Presses folded into an action already in flight
+ * 		dropped		Presses ignored by BUTTON_DISPATCH_DROP or a full queue
+ * 		avg_wait_us	Average time a button's first run waited for a worker
+ * 		max_wait_us	Longest time a button's first run waited for a worker
+ */
+struct button_pool_stats {
+	unsigned int depth;
+	unsigned int max_depth;
+	unsigned long dispatched;
+	unsigned long coalesced;
+	unsigned long dropped;
+	unsigned int avg_wait_us;
+	unsigned int max_wait_us;
+};
+
 /**
  * Struct containing pertinent information to be passed to the thread that will
  * be watching this button. Includes:
- * 		GPIO context from the MRAA library
- * 		Pointer to the funciton this button will call
+ * 		GPIO context from the MRAA library, or NULL when the button is read from the
+ * 		shared GPIO line set instead
+ * 		Pointer to the funciton this button will call (published atomically)
  * 		Bit used for this button's debouncing
+ * 		This button's BUTTON_BIT_* in the published button state
+ * 		Press and release thresholds for this button's shift register
+ * 		Flag telling the watching thread to exit
+ * 		Count of the watching thread's passes, used to tell when an old callback
+ * 		can no longer be running
+ * 		Fast and idle polling intervals in microseconds
+ * 		Polling counters and the time they started, plus time spent backed off
+ * 		How the action is dispatched, whether it is queued or running on the worker
+ * 		pool, and how many more runs are waiting for it to finish
+ * 		Bounce recording while the button is calibrating, NULL otherwise
  * 		Pointer to the thread that will be watching this button
  */
 struct button_context {
 	mraa_gpio_context gpio_button_context;
 	void (*action)();
 	unsigned char bits;
+	uint8_t mask_bit;
+	uint8_t press_threshold;
+	uint8_t release_threshold;
 	uint8_t endFlag;
+	uint32_t passes;
+	unsigned int poll_fast_us;
+	unsigned int poll_idle_us;
+	struct button_poll_stats poll;
+	uint64_t poll_start_us;
+	uint64_t poll_idle_time_us;
+	enum button_dispatch dispatch;
+	unsigned int in_flight;
+	unsigned int pending;
+	struct button_calib * calib;
 	pthread_t * thread;
 };
 
@@ -73,11 +258,21 @@ struct button_context {
  */
 struct button_context * button_init(int, void (*)());
 
+/**
+ * Bit used in a debounced button bitmask for a raw button pin.
+ *
+ * @param int The raw pin of the button (PIN_A ... PIN_SELECT)
+ *
+ * @return    The BUTTON_BIT_* for the pin, or 0 when it is not a button pin
+ */
+uint8_t button_pin_bit(int);
+
 /**
  * Function to be watched by the thread that is responsible for debouncing this button
- * and calling the funciton that has been assigned to this button.
+ * and calling the funciton that has been assigned to this button. Every debounced
+ * change is also published to the shared button state (see button_state.h).
  *
- * @param void* Pointer to the function to be called by this button
+ * @param void* Pointer to the button_context this thread is watching
  *
  * @return      Pointer to this function to allow the passing of this function to the
  *              pthread that will be watching this button.
@@ -86,14 +281,153 @@ void * buttonThread(void*);
 
 /**
  * Change/Update the callback function to be called by the desired button_context.
+ * The new function is published with a single atomic store, so it is safe to call
+ * at any time (including from inside the current callback) and costs no more than
+ * a pointer write. Presses seen after this returns call the new function; a press
+ * already in progress may still finish in the old one. Use button_synchronize() if
+ * the old function must no longer be running.
  *
  * @param button_context Pointer to the button context to be updated
  * @param void*          Pointer to the new function for this button to inact
  */
-void button_update_function(struct button_context*, void*);
+void button_update_function(struct button_context*, void (*)());
+
+/**
+ * Wait until any callback that started before this call has returned. After a
+ * button_update_function(), this guarantees the old function is no longer running,
+ * so anything it uses can be safely torn down. For pooled buttons this also waits
+ * for runs queued on the worker pool. Returns right away when called from the
+ * button's own callback or after the button has been told to close.
+ *
+ * @param button_context Pointer to the button to wait on
+ */
+void button_synchronize(struct button_context*);
+
+/**
+ * Change the polling intervals used by the thread watching a button. The fast
+ * interval sets how quickly a press is debounced; the idle interval bounds the added
+ * detection delay while saving wakeups when the button sits unused. Set both to the
+ * same value for fixed-rate polling.
+ *
+ * @param button_context Pointer to the button to configure
+ * @param unsigned int   Fast polling interval in microseconds
+ * @param unsigned int   Idle polling interval in microseconds
+ */
+void button_set_poll_rate(struct button_context*, unsigned int, unsigned int);
+
+/**
+ * Read the polling counters of a button.
+ *
+ * @param button_context    Pointer to the button to read
+ * @param button_poll_stats Filled in with the current counters and rates
+ */
+void button_get_poll_stats(struct button_context*, struct button_poll_stats*);
+
+/**
+ * Set how many consecutive samples a button must hold a new level before it counts
+ * as pressed or released (1-8). The defaults, PRESS_THRESHOLD and RELEASE_THRESHOLD,
+ * are 2 and 6.
+ *
+ * @param button_context Pointer to the button to configure
+ * @param int            Samples needed for a press
+ * @param int            Samples needed for a release
+ */
+void button_set_settle(struct button_context*, int, int);
+
+/**
+ * Start recording the bounce of a button. Press and release the button normally a
+ * few dozen times, then call button_calib_finish(). In BUTTON_STATIC_POOL builds at
+ * most BUTTON_CALIB_BURSTS bursts are kept. Timing resolution is the fast
+ * poll interval, so lower it with button_set_poll_rate() for switches that settle
+ * in well under a millisecond.
+ *
+ * @param button_context Pointer to the button to calibrate
+ * @param unsigned int   Maximum number of bounce bursts to record
+ *
+ * @return 0 on success, -1 if the recording buffer couldn't be allocated
+ */
+int button_calib_start(struct button_context*, unsigned int);
+
+/**
+ * Stop recording, estimate the button's bounce duration distribution and set the
+ * smallest settle window (for both press and release) that keeps presses that bounce
+ * longer than it below the target rate.
+ *
+ * @param button_context       Pointer to the button being calibrated
+ * @param float                Target false-trigger rate (e.g. BUTTON_CALIB_TARGET)
+ * @param button_calibration   Filled in with the measurements and chosen window
+ *
+ * @return 0 on success, -1 if calibration wasn't started or no bursts were seen
+ */
+int button_calib_finish(struct button_context*, float, struct button_calibration*);
+
+/**
+ * Estimate a settle window from measured bounce durations. The window is the larger
+ * of the empirical quantile for the target rate and the same quantile of a shifted
+ * exponential fitted to the durations, which covers targets rarer than the number of
+ * bursts measured can show.
+ *
+ * @param unsigned int*      Bounce durations in microseconds (sorted in place)
+ * @param unsigned int       Number of durations
+ * @param float              Target false-trigger rate
+ * @param unsigned int       Sample interval in microseconds
+ * @param button_calibration Filled in with the estimate
+ */
+void button_calib_estimate(unsigned int*, unsigned int, float, unsigned int,
+		struct button_calibration*);
+
+/**
+ * Record one raw sample while calibrating. Called by the thread watching the button.
+ *
+ * @param button_calib The recording buffer
+ * @param int          Raw pin value
+ * @param uint64_t     Time of the sample in microseconds
+ */
+void button_calib_record(struct button_calib*, int, uint64_t);
+
+/**
+ * Choose how a button runs its action. Anything but BUTTON_DISPATCH_INLINE hands
+ * the action to a small fixed pool of worker threads (started on first use) so a
+ * long-running action never stops the button from being watched.
+ *
+ * @param button_context  Pointer to the button to configure
+ * @param button_dispatch The dispatch policy to use for this button
+ */
+void button_set_dispatch(struct button_context*, enum button_dispatch);
+
+/**
+ * Run a button's action according to its dispatch policy. Called by the thread
+ * watching the button when a press is debounced.
+ *
+ * @param button_context Pointer to the button that was pressed
+ * @param void*          The action to run
+ */
+void button_dispatch_action(struct button_context*, void (*)());
+
+/**
+ * Wait until none of a button's actions are queued or running on the worker pool.
+ *
+ * @param button_context Pointer to the button to wait on
+ */
+void button_pool_drain(struct button_context*);
+
+/**
+ * Read the worker pool counters.
+ *
+ * @param button_pool_stats Filled in with the current counters
+ */
+void button_get_pool_stats(struct button_pool_stats*);
+
+/**
+ * Stop the worker pool, letting queued actions finish first. Pooled buttons run
+ * their actions inline afterwards.
+ */
+void button_pool_shutdown(void);
 
 /**
- * Deallocate memory for a button_context and its members.
+ * Stop the thread watching a button, wait for it to exit and deallocate memory for
+ * the button_context and its members. Must not be called from the button's own
+ * callback.
  *
  * @param button_context Pointer to the button to close.
  */
@@ -0,0 +1,165 @@
+/**
+ * @file
+ * @brief Header-only C++ layer over the button definitions in button.h. Each
+ * button's pin, debounce thresholds and press/release handlers are template
+ * parameters, so the compiler sees all of them as constants. A ButtonGroup expands
+ * into a single scan loop over all of its buttons with every debounce step and
+ * handler call inlined; no function pointers or per-button threads are involved.
+ *
+ * e.g.: struct Next { static void run() { page++; } };
+ * 		 ButtonGroup<Button<PIN_UP, Next>, Button<PIN_SELECT> > buttons;
+ * 		 for (;;) { uint8_t pressed = buttons.scan(); usleep(1000); }
+ */
+
+#ifndef BUTTON_HPP_
+#define BUTTON_HPP_
+
+#include <stdint.h>
+#include "mraa.hpp"
+#include "button.h"
+
+namespace button {
+
+/**
+ * Bit used in the debounced bitmask for a raw Edison button pin.
+ *
+ * @param pin The raw pin of the button (PIN_A ... PIN_SELECT)
+ *
+ * @return The BUTTON_BIT_* for the pin, or 0 when it is not a button pin
+ */
+constexpr uint8_t bitForPin(int pin) {
+	return pin == PIN_A ? BUTTON_BIT_A :
+			pin == PIN_B ? BUTTON_BIT_B :
+			pin == PIN_UP ? BUTTON_BIT_UP :
+			pin == PIN_DOWN ? BUTTON_BIT_DOWN :
+			pin == PIN_LEFT ? BUTTON_BIT_LEFT :
+			pin == PIN_RIGHT ? BUTTON_BIT_RIGHT :
+			pin == PIN_SELECT ? BUTTON_BIT_SELECT : 0;
+}
+
+/**
+ * Shift register debouncing, the same scheme used by the C library. Each sample is
+ * shifted in at the top; the button is pressed once the register drops to Press or
+ * below and released once it climbs to Release or above.
+ */
+template <uint8_t Press = PRESS_THRESHOLD, uint8_t Release = RELEASE_THRESHOLD>
+struct ShiftDebounce {
+	static constexpr uint8_t press = Press;
+	static constexpr uint8_t release = Release;
+
+	/**
+	 * Shift in one raw sample and work out the debounced state.
+	 *
+	 * @param reg The button's shift register
+	 * @param value The raw pin value (0 = pressed)
+	 * @param down The current debounced state
+	 *
+	 * @return The new debounced state
+	 */
+	static inline bool update(uint8_t& reg, int value, bool down) {
+		reg = (reg >> 1) | (value == 1 ? BIT_MASK : 0);
+		return down ? reg < Release : reg <= Press;
+	}
+};
+
+/**
+ * Handler that does nothing; used when a button only feeds the bitmask.
+ */
+struct NoAction {
+	static inline void run() {
+	}
+};
+
+/**
+ * A single button on a fixed pin.
+ *
+ * @tparam Pin The raw pin of the button (PIN_A ... PIN_SELECT)
+ * @tparam OnPress Type with a static run() called when the button is pressed
+ * @tparam OnRelease Type with a static run() called when the button is released
+ * @tparam Policy Debounce policy with a static update() like ShiftDebounce
+ */
+template <int Pin, class OnPress = NoAction, class OnRelease = NoAction,
+		class Policy = ShiftDebounce<> >
+class Button {
+public:
+	static constexpr int pin = Pin;
+	static constexpr uint8_t bit = bitForPin(Pin);
+	static_assert(bit != 0, "Pin is not one of the block's buttons");
+
+	Button() : gpio(Pin, true, true), reg(0xFF), down(false) {
+		gpio.dir(mraa::DIR_IN);
+	}
+
+	/**
+	 * Read and debounce the button once, calling its handler on a change.
+	 *
+	 * @return This button's bit if it is pressed, 0 otherwise
+	 */
+	inline uint8_t sample() {
+		bool now = Policy::update(reg, gpio.read(), down);
+		if (now != down) {
+			down = now;
+			if (down)
+				OnPress::run();
+			else
+				OnRelease::run();
+		}
+		return down ? bit : 0;
+	}
+
+	/**
+	 * @return true while the debounced button is pressed
+	 */
+	inline bool pressed() const {
+		return down;
+	}
+
+private:
+	mraa::Gpio gpio;
+	uint8_t reg;
+	bool down;
+
+	Button(const Button&);
+	Button& operator=(const Button&);
+};
+
+/**
+ * A set of buttons scanned together. scan() unrolls into one pass over every
+ * button in the group.
+ */
+template <class... Buttons>
+class ButtonGroup;
+
+template <>
+class ButtonGroup<> {
+public:
+	static constexpr uint8_t mask = 0;
+
+	inline uint8_t scan() {
+		return 0;
+	}
+};
+
+template <class Head, class... Tail>
+class ButtonGroup<Head, Tail...> : private ButtonGroup<Tail...> {
+public:
+	static constexpr uint8_t mask = Head::bit | ButtonGroup<Tail...>::mask;
+	static_assert((Head::bit & ButtonGroup<Tail...>::mask) == 0,
+			"A button appears twice in the group");
+
+	/**
+	 * Read and debounce every button in the group once.
+	 *
+	 * @return Debounced bitmask of the pressed buttons (BUTTON_BIT_*)
+	 */
+	inline uint8_t scan() {
+		return head.sample() | ButtonGroup<Tail...>::scan();
+	}
+
+private:
+	Head head;
+};
+
+} // namespace button
+
+#endif /* BUTTON_HPP_ */
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <math.h>
+#include "button.h"
+
+/*
+ * Debounce calibration. The thread watching a button feeds every raw sample to
+ * button_calib_record(), which times each burst of edges from its first to its last
+ * transition. button_calib_estimate() turns the recorded bursts into the smallest
+ * settle window that meets a target false-trigger rate.
+ */
+
+void button_calib_record(struct button_calib * calib, int value, uint64_t now) {
+	if (calib->last_value < 0) { // first sample: nothing to compare against yet
+		calib->last_value = value;
+		return;
+	}
+
+	if (value != calib->last_value) {
+		if (calib->burst_start_us == 0)
+			calib->burst_start_us = now;
+		calib->burst_last_us = now;
+		calib->last_value = value;
+	} else if (calib->burst_start_us != 0 && now - calib->burst_last_us >= BUTTON_CALIB_GAP_US) {
+		// quiet long enough: the burst is over
+		unsigned int count = calib->count;
+		if (count < calib->capacity) {
+			calib->durations[count] = (unsigned int) (calib->burst_last_us - calib->burst_start_us);
+			__atomic_store_n(&calib->count, count + 1, __ATOMIC_RELEASE);
+		}
+		calib->burst_start_us = 0;
+	}
+}
+
+static int compare(const void * a, const void * b) {
+	unsigned int x = *(const unsigned int *) a;
+	unsigned int y = *(const unsigned int *) b;
+	return x < y ? -1 : x > y;
+}
+
+void button_calib_estimate(unsigned int * durations, unsigned int count, float target,
+		unsigned int sample_us, struct button_calibration * result) {
+	double mean = 0, fitted;
+	unsigned int i, quantile, window, samples;
+
+	if (target <= 0.0f || target >= 1.0f)
+		target = BUTTON_CALIB_TARGET;
+	if (sample_us == 0)
+		sample_us = 1;
+
+	qsort(durations, count, sizeof(unsigned int), &compare);
+	for (i = 0; i < count; i++)
+		mean += durations[i];
+	mean /= count;
+
+	result->bursts = count;
+	result->min_us = durations[0];
+	result->median_us = durations[count / 2];
+	result->max_us = durations[count - 1];
+
+	// bounce longer than this happened in no more than target of the bursts seen
+	i = (unsigned int) ceil((1.0 - target) * count);
+	quantile = durations[i > 0 ? i - 1 : 0];
+
+	// tail of a shifted exponential fit, for rates rarer than 1 / count
+	fitted = durations[0] + (mean - durations[0]) * log(1.0 / target);
+
+	window = quantile;
+	if (fitted > window)
+		window = (unsigned int) ceil(fitted);
+	result->window_us = window;
+
+	// every sample inside the window may still be bouncing; one more must agree
+	samples = window / sample_us + 1;
+	if (samples > 8)
+		samples = 8;
+	result->samples = (uint8_t) samples;
+	result->press_threshold = 0xFF >> samples;
+	result->release_threshold = (uint8_t) (0xFF << (8 - samples));
+}
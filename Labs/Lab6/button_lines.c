@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "button_lines.h"
+#include "button_state.h"
+
+/*
+ * Current time on the clock the kernel uses for line event timestamps.
+ */
+static uint64_t now_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+int button_lines_open(struct button_lines * lines, const char * chip, const int * pins, int count) {
+	struct gpio_v2_line_request request;
+	int chipFd, i;
+
+	if (count < 1 || count > BUTTON_LINES_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(lines, 0, sizeof(*lines));
+	lines->fd = -1;
+	memset(&request, 0, sizeof(request));
+	for (i = 0; i < count; i++) {
+		lines->bits[i] = button_pin_bit(pins[i]);
+		if (lines->bits[i] == 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		request.offsets[i] = pins[i];
+	}
+	strncpy(request.consumer, "button", sizeof(request.consumer) - 1);
+	request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING
+			| GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	request.num_lines = count;
+	request.event_buffer_size = 16 * count;
+
+	chipFd = open(chip, O_RDONLY | O_CLOEXEC);
+	if (chipFd < 0)
+		return -1;
+	if (ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+		int err = errno;
+		close(chipFd);
+		errno = err;
+		return -1;
+	}
+	close(chipFd); // the line request keeps its own reference to the chip
+
+	lines->fd = request.fd;
+	lines->count = count;
+	lines->settle_ns = BUTTON_LINES_SETTLE_NS;
+
+	// start from the current state so nothing held at startup reads as a press
+	if (button_lines_read(lines, &lines->raw) < 0) {
+		button_lines_close(lines);
+		return -1;
+	}
+	lines->mask = lines->raw;
+	return 0;
+}
+
+int button_lines_open_all(struct button_lines * lines) {
+	static const int pins[BUTTON_LINES_MAX] = {
+		PIN_A, PIN_B, PIN_UP, PIN_DOWN, PIN_LEFT, PIN_RIGHT, PIN_SELECT
+	};
+	return button_lines_open(lines, BUTTON_LINES_CHIP, pins, BUTTON_LINES_MAX);
+}
+
+int button_lines_read(struct button_lines * lines, uint8_t * raw) {
+	struct gpio_v2_line_values values;
+	uint8_t pressed = 0;
+	int i;
+
+	values.mask = (1ULL << lines->count) - 1;
+	values.bits = 0;
+	if (ioctl(lines->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+		return -1;
+	lines->reads++;
+
+	for (i = 0; i < lines->count; i++)
+		if (!(values.bits & (1ULL << i))) // buttons pull low when pressed
+			pressed |= lines->bits[i];
+	*raw = pressed;
+	return 0;
+}
+
+int button_lines_wait(struct button_lines * lines, int timeout_ms) {
+	struct gpio_v2_line_event events[16];
+	struct pollfd pfd;
+	struct timespec timeout, * wait = NULL;
+	uint64_t now = now_ns(), deadline = 0;
+	int i, n, received = 0;
+
+	// lines whose raw value disagrees with the debounced one need waking at settle
+	for (i = 0; i < lines->count; i++) {
+		if ((lines->raw ^ lines->mask) & lines->bits[i]) {
+			uint64_t due = lines->last_edge_ns[i] + lines->settle_ns;
+			if (wait == NULL || due < deadline)
+				deadline = due;
+			wait = &timeout;
+		}
+	}
+	if (timeout_ms >= 0 && (wait == NULL || deadline > now + timeout_ms * 1000000ULL)) {
+		deadline = now + timeout_ms * 1000000ULL;
+		wait = &timeout;
+	}
+	if (wait != NULL) {
+		uint64_t left = deadline > now ? deadline - now : 0;
+		timeout.tv_sec = left / 1000000000ULL;
+		timeout.tv_nsec = left % 1000000000ULL;
+	}
+
+	pfd.fd = lines->fd;
+	pfd.events = POLLIN;
+	n = ppoll(&pfd, 1, wait, NULL);
+	if (n <= 0)
+		return n;
+
+	n = read(lines->fd, events, sizeof(events));
+	if (n < 0)
+		return -1;
+	for (i = 0; i < n / (int) sizeof(events[0]); i++) {
+		int line;
+		for (line = 0; line < lines->count; line++) {
+			if (lines->bits[line] == button_pin_bit(events[i].offset)) {
+				lines->last_edge_ns[line] = events[i].timestamp_ns;
+				break;
+			}
+		}
+		received++;
+	}
+	lines->events += received;
+	return received;
+}
+
+int button_lines_update(struct button_lines * lines, uint8_t * mask) {
+	uint8_t raw, before = lines->mask;
+	uint64_t now;
+	int i;
+
+	if (button_lines_read(lines, &raw) < 0)
+		return -1;
+	now = now_ns();
+
+	for (i = 0; i < lines->count; i++) {
+		uint8_t bit = lines->bits[i];
+
+		// a change we read without an event still restarts the settle time
+		if (((raw ^ lines->raw) & bit) && lines->last_edge_ns[i] + lines->settle_ns <= now)
+			lines->last_edge_ns[i] = now;
+
+		if (((raw ^ lines->mask) & bit) && lines->last_edge_ns[i] + lines->settle_ns <= now)
+			lines->mask ^= bit;
+	}
+	lines->raw = raw;
+
+	if (lines->mask != before)
+		buttons_publish(lines->mask & ~before, before & ~lines->mask);
+
+	*mask = lines->mask;
+	return lines->mask != before;
+}
+
+void button_lines_close(struct button_lines * lines) {
+	if (lines->fd >= 0)
+		close(lines->fd);
+	lines->fd = -1;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file
+ * @brief Button backend using the Linux GPIO character device instead of one sysfs
+ * file per button. All button lines are requested from the kernel as one line set,
+ * so reading every button is a single ioctl, and edges are reported by the kernel
+ * with hardware-accurate timestamps.
+ *
+ * Debouncing is done in time rather than in samples: a line's debounced state
+ * follows its raw value once no edge has been seen on it for the settle time. The
+ * thread using the lines can sleep in button_lines_wait() until an edge or a settle
+ * deadline instead of polling.
+ *
+ * button.c reads the buttons it watches through one shared line set whenever the
+ * chip can be opened, and falls back to MRAA when it can't.
+ *
+ * e.g.: struct button_lines lines;
+ * 		 uint8_t pressed;
+ * 		 button_lines_open_all(&lines);
+ * 		 for (;;) {
+ * 		 	button_lines_wait(&lines, -1);
+ * 		 	if (button_lines_update(&lines, &pressed) == 1)
+ * 		 		... pressed changed ...
+ * 		 }
+ */
+
+#ifndef BUTTON_LINES_H_
+#define BUTTON_LINES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "button.h"
+
+/**
+ * GPIO chip holding the button lines. On the Edison every GPIO is on gpiochip0,
+ * whose base is 0, so a raw pin number is also its line offset.
+ */
+#define BUTTON_LINES_CHIP		"/dev/gpiochip0"
+
+/**
+ * Maximum number of lines in one set (one per button)
+ */
+#define BUTTON_LINES_MAX		7
+
+/**
+ * Default time a line must be free of edges before its new value is accepted:
+ * 3 ms, the same as RELEASE_THRESHOLD's six samples at the 500 us poll rate.
+ */
+#define BUTTON_LINES_SETTLE_NS	3000000ULL
+
+/**
+ * A set of button lines requested together.
+ * 		fd				Line request file descriptor from the kernel
+ * 		count			Number of lines in the set
+ * 		bits			BUTTON_BIT_* of each line
+ * 		settle_ns		Time a line must be quiet before its value is accepted
+ * 		last_edge_ns	Kernel timestamp of the latest edge on each line
+ * 		raw				Pressed bitmask from the latest read
+ * 		mask			Debounced pressed bitmask
+ * 		reads			Number of read ioctls issued
+ * 		events			Number of edge events received
+ */
+struct button_lines {
+	int fd;
+	int count;
+	uint8_t bits[BUTTON_LINES_MAX];
+	uint64_t settle_ns;
+	uint64_t last_edge_ns[BUTTON_LINES_MAX];
+	uint8_t raw;
+	uint8_t mask;
+	unsigned long reads;
+	unsigned long events;
+};
+
+/**
+ * Request a set of button lines as inputs with edge detection on both edges.
+ *
+ * @param button_lines The line set to initialize
+ * @param char*        Path of the GPIO chip (e.g. BUTTON_LINES_CHIP)
+ * @param int*         Raw pins of the buttons (PIN_A ... PIN_SELECT)
+ * @param int          Number of pins (at most BUTTON_LINES_MAX)
+ *
+ * @return 0 on success, -1 with errno set on failure
+ */
+int button_lines_open(struct button_lines*, const char*, const int*, int);
+
+/**
+ * Request all seven buttons of the block from BUTTON_LINES_CHIP.
+ *
+ * @param button_lines The line set to initialize
+ *
+ * @return 0 on success, -1 with errno set on failure
+ */
+int button_lines_open_all(struct button_lines*);
+
+/**
+ * Read every line in the set with a single ioctl.
+ *
+ * @param button_lines The line set to read
+ * @param uint8_t*     Filled in with the raw pressed bitmask
+ *
+ * @return 0 on success, -1 with errno set on failure
+ */
+int button_lines_read(struct button_lines*, uint8_t*);
+
+/**
+ * Sleep until an edge arrives or a line that is settling reaches its deadline, then
+ * record the kernel timestamps of any edges. While every line is settled it sleeps
+ * until an edge or the timeout.
+ *
+ * @param button_lines The line set to wait on
+ * @param int          Longest time to sleep in milliseconds, or -1 for no limit
+ *
+ * @return Number of edge events received, or -1 with errno set on failure
+ */
+int button_lines_wait(struct button_lines*, int);
+
+/**
+ * Read the lines and update the debounced state of every line that has been
+ * quiet for the settle time. Changes are also published to the shared button state
+ * (see button_state.h).
+ *
+ * @param button_lines The line set to update
+ * @param uint8_t*     Filled in with the debounced pressed bitmask
+ *
+ * @return 1 if the debounced bitmask changed, 0 if not, -1 on failure
+ */
+int button_lines_update(struct button_lines*, uint8_t*);
+
+/**
+ * Release the line set back to the kernel.
+ *
+ * @param button_lines The line set to close
+ */
+void button_lines_close(struct button_lines*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BUTTON_LINES_H_ */
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "button.h"
+
+/*
+ * Fixed pool of worker threads that run button actions so a long action (a full
+ * scan, a motor move) never blocks the thread debouncing the button. Actions wait
+ * in a bounded ring; all pool state is guarded by one mutex since it is only touched
+ * once per press and once per finished action.
+ *
+ * A button has at most one job in the ring or running at a time, so its action never
+ * runs twice at once. Presses that arrive meanwhile are counted on the button and run
+ * one after another by the same worker, each with the button's current action.
+ */
+
+struct button_job {
+	struct button_context * context;
+	void (*action)();
+	uint64_t queued_us;
+};
+
+static struct button_job queue[BUTTON_QUEUE_DEPTH];
+static unsigned int head, count;
+
+static pthread_t workers[BUTTON_WORKERS];
+#ifdef BUTTON_STATIC_POOL
+static char stacks[BUTTON_WORKERS][BUTTON_STACK_SIZE] __attribute__((aligned(16)));
+#endif
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+static int running, stopping;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+
+static struct button_pool_stats stats;
+static uint64_t total_wait_us;
+static unsigned long started_jobs;
+
+// the context whose action this worker is running, so it can't wait on itself
+static __thread struct button_context * current;
+
+static uint64_t now_us(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void * worker(void * args) {
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		struct button_job job;
+		unsigned int wait;
+
+		while (count == 0 && !stopping)
+			pthread_cond_wait(&work, &lock);
+		if (count == 0)
+			break; // stopping and nothing left to run
+
+		job = queue[head];
+		head = (head + 1) % BUTTON_QUEUE_DEPTH;
+		count--;
+		stats.depth = count;
+
+		wait = (unsigned int) (now_us() - job.queued_us);
+		total_wait_us += wait;
+		started_jobs++;
+		if (wait > stats.max_wait_us)
+			stats.max_wait_us = wait;
+
+		// run once, then again for every press held back while it ran, picking up
+		// any action set by button_update_function() in the meantime
+		for (;;) {
+			pthread_mutex_unlock(&lock);
+			current = job.context;
+			job.action();
+			current = NULL;
+			pthread_mutex_lock(&lock);
+			if (job.context->pending == 0)
+				break;
+			job.context->pending--;
+			job.action = __atomic_load_n(&job.context->action, __ATOMIC_ACQUIRE);
+		}
+
+		job.context->in_flight = 0;
+		pthread_cond_broadcast(&idle);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+static void start_workers(void) {
+	pthread_attr_t attr;
+	int i;
+	pthread_mutex_lock(&lock);
+	if (stopping) { // shut down before anything was pooled
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	pthread_attr_init(&attr);
+	for (i = 0; i < BUTTON_WORKERS; i++) {
+#ifdef BUTTON_STATIC_POOL
+		pthread_attr_setstack(&attr, stacks[i], BUTTON_STACK_SIZE);
+#endif
+		if (pthread_create(&workers[i], &attr, &worker, NULL) != 0) {
+			fprintf(stderr, "Couldn't start button worker %d, exiting", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+	pthread_attr_destroy(&attr);
+	running = 1;
+	pthread_mutex_unlock(&lock);
+}
+
+void button_set_dispatch(struct button_context * context, enum button_dispatch dispatch){
+	pthread_mutex_lock(&lock);
+	context->dispatch = dispatch;
+	pthread_mutex_unlock(&lock);
+}
+
+void button_dispatch_action(struct button_context * context, void (*action)()){
+	enum button_dispatch dispatch;
+
+	pthread_mutex_lock(&lock);
+	dispatch = context->dispatch;
+	pthread_mutex_unlock(&lock);
+	if (dispatch == BUTTON_DISPATCH_INLINE) {
+		action();
+		return;
+	}
+
+	pthread_once(&started, &start_workers);
+
+	pthread_mutex_lock(&lock);
+	if (stopping) {
+		pthread_mutex_unlock(&lock);
+		action();
+		return;
+	}
+
+	if (context->in_flight > 0) {
+		// already queued or running: the worker running it picks the press up after
+		if (context->dispatch == BUTTON_DISPATCH_COALESCE) {
+			context->pending = 1;
+			stats.coalesced++;
+		} else if (context->dispatch == BUTTON_DISPATCH_QUEUE
+				&& context->pending < BUTTON_QUEUE_DEPTH) {
+			context->pending++;
+			stats.dispatched++;
+		} else {
+			stats.dropped++;
+		}
+	} else if (count == BUTTON_QUEUE_DEPTH) {
+		stats.dropped++;
+	} else {
+		struct button_job * job = &queue[(head + count) % BUTTON_QUEUE_DEPTH];
+		job->context = context;
+		job->action = action;
+		job->queued_us = now_us();
+		count++;
+		context->in_flight = 1;
+		context->pending = 0;
+		stats.dispatched++;
+		stats.depth = count;
+		if (count > stats.max_depth)
+			stats.max_depth = count;
+		pthread_cond_signal(&work);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void button_pool_drain(struct button_context * context){
+	if (current == context)
+		return; // called from this button's own action
+	pthread_mutex_lock(&lock);
+	while (context->in_flight > 0)
+		pthread_cond_wait(&idle, &lock);
+	pthread_mutex_unlock(&lock);
+}
+
+void button_get_pool_stats(struct button_pool_stats * out){
+	pthread_mutex_lock(&lock);
+	*out = stats;
+	out->avg_wait_us = started_jobs ? (unsigned int) (total_wait_us / started_jobs) : 0;
+	pthread_mutex_unlock(&lock);
+}
+
+void button_pool_shutdown(void){
+	int i, joined;
+
+	pthread_mutex_lock(&lock);
+	stopping = 1;
+	joined = running;
+	running = 0;
+	pthread_cond_broadcast(&work);
+	pthread_mutex_unlock(&lock);
+
+	if (joined)
+		for (i = 0; i < BUTTON_WORKERS; i++)
+			pthread_join(workers[i], NULL);
+}
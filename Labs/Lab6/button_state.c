@@ -0,0 +1,83 @@
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "button_state.h"
+
+// bits 0-7: pressed mask, bits 8-31: sequence number
+static uint32_t state;
+static uint32_t waiters;
+
+#define STATE_MASK(w)	((uint8_t) ((w) & 0xFF))
+#define STATE_SEQ(w)	((w) >> 8)
+
+static struct buttons_state unpack(uint32_t word) {
+	struct buttons_state s;
+	s.seq = STATE_SEQ(word);
+	s.mask = STATE_MASK(word);
+	return s;
+}
+
+struct buttons_state buttons_snapshot(void) {
+	return unpack(__atomic_load_n(&state, __ATOMIC_ACQUIRE));
+}
+
+void buttons_publish(uint8_t set, uint8_t clear) {
+	uint32_t old = __atomic_load_n(&state, __ATOMIC_RELAXED), word;
+	do {
+		uint8_t mask = (STATE_MASK(old) | set) & ~clear;
+		if (mask == STATE_MASK(old))
+			return;
+		word = ((STATE_SEQ(old) + 1) << 8) | mask;
+	} while (!__atomic_compare_exchange_n(&state, &old, word, 1, __ATOMIC_ACQ_REL,
+			__ATOMIC_RELAXED));
+
+	if (__atomic_load_n(&waiters, __ATOMIC_SEQ_CST) > 0)
+		syscall(SYS_futex, &state, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+int buttons_wait_change(uint32_t seq, int timeout_ms, struct buttons_state * out) {
+	struct timespec deadline, now, left;
+	uint32_t word;
+
+	if (timeout_ms >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	__atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+	for (;;) {
+		word = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+		if (STATE_SEQ(word) != (seq & 0xFFFFFF))
+			break;
+
+		if (timeout_ms >= 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			left.tv_sec = deadline.tv_sec - now.tv_sec;
+			left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+			if (left.tv_nsec < 0) {
+				left.tv_sec--;
+				left.tv_nsec += 1000000000L;
+			}
+			if (left.tv_sec < 0)
+				break;
+		}
+
+		// sleeps only if the word still holds the state we just checked
+		if (syscall(SYS_futex, &state, FUTEX_WAIT_PRIVATE, word,
+				timeout_ms >= 0 ? &left : NULL, NULL, 0) < 0 && errno == ETIMEDOUT)
+			break;
+	}
+	__atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+
+	word = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+	*out = unpack(word);
+	return STATE_SEQ(word) != (seq & 0xFFFFFF);
+}
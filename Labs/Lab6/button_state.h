@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief Process-wide debounced button state published as a single atomic word.
+ * The low 8 bits hold the bitmask of pressed buttons (BUTTON_BIT_*) and the upper
+ * 24 bits a sequence number that increases on every change, so a reader always sees
+ * a consistent mask together with the change it belongs to. Readers can take a
+ * snapshot at any time or sleep on a futex until the state changes.
+ */
+
+#ifndef BUTTON_STATE_H_
+#define BUTTON_STATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "button.h"
+
+/**
+ * One consistent view of the buttons.
+ * 		seq		Change counter (24 bits, wraps)
+ * 		mask	Bitmask of the pressed buttons (BUTTON_BIT_*)
+ */
+struct buttons_state {
+	uint32_t seq;
+	uint8_t mask;
+};
+
+/**
+ * Read the current button state.
+ *
+ * @return The current mask and the sequence number it was published with
+ */
+struct buttons_state buttons_snapshot(void);
+
+/**
+ * Set and clear bits of the published state in one atomic step and wake anyone
+ * waiting for a change. Nothing is published if the mask ends up the same. Called
+ * by the debouncers.
+ *
+ * @param uint8_t Buttons that are now pressed
+ * @param uint8_t Buttons that are now released
+ */
+void buttons_publish(uint8_t, uint8_t);
+
+/**
+ * Sleep until the button state differs from the sequence number given.
+ *
+ * @param uint32_t       Sequence number of the state the caller already has
+ * @param int            Maximum time to wait in milliseconds, or -1 for no limit
+ * @param buttons_state  Filled in with the state on return
+ *
+ * @return 1 if the state changed, 0 if the wait timed out
+ */
+int buttons_wait_change(uint32_t, int, struct buttons_state*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BUTTON_STATE_H_ */
@@ -0,0 +1,275 @@
+#include <string.h>
+#include <time.h>
+#include "gesture.h"
+
+// wrap-safe check for whether time t has been reached at time now
+#define DUE(now, t) ((int32_t)((now) - (t)) >= 0)
+
+/*
+ * Events collected while the lock is held and delivered once it is released, so a
+ * handler is free to call back into the recognizer.
+ */
+struct gesture_batch {
+	struct gesture_event events[GESTURE_MAX_EVENTS];
+	int count;
+};
+
+static void push(struct gesture_batch * batch, enum gesture_type type, uint8_t mask,
+		uint16_t count, uint32_t time) {
+	if (batch->count < GESTURE_MAX_EVENTS) {
+		struct gesture_event * e = &batch->events[batch->count++];
+		e->type = type;
+		e->mask = mask;
+		e->count = count;
+		e->time = time;
+	}
+}
+
+static void deliver(struct gesture_recognizer * g, struct gesture_batch * batch) {
+	int i;
+	if (g->handler == NULL)
+		return;
+	for (i = 0; i < batch->count; i++)
+		g->handler(&batch->events[i], g->user);
+}
+
+/*
+ * Report the press of button i and start its repeat timer. Called right away for
+ * normal buttons and after the chord window for buttons that belong to a chord.
+ */
+static void fire_press(struct gesture_recognizer * g, int i, struct gesture_batch * batch) {
+	struct gesture_button * b = &g->buttons[i];
+	uint8_t bit = 1 << i;
+
+	b->press_pending = 0;
+	push(batch, GESTURE_PRESS, bit, 0, b->press_time);
+
+	if (b->clicked && b->press_time - b->release_time <= g->config.double_click_ms) {
+		push(batch, GESTURE_DOUBLE_CLICK, bit, 0, b->press_time);
+		b->clicked = 2; // this press finished a double-click
+	} else {
+		b->clicked = 0;
+	}
+
+	b->repeats = 0;
+	b->repeat_interval = g->config.repeat_interval_ms;
+	b->repeat_time = b->press_time + g->config.repeat_delay_ms;
+}
+
+/*
+ * Fire every timed gesture (delayed press, long-press, repeat) that is due.
+ */
+static void process_due(struct gesture_recognizer * g, uint32_t now, struct gesture_batch * batch) {
+	const struct gesture_config * c = &g->config;
+	int i;
+	for (i = 0; i < GESTURE_BUTTONS; i++) {
+		struct gesture_button * b = &g->buttons[i];
+		uint8_t bit = 1 << i;
+
+		if (!(g->mask & bit))
+			continue;
+		if (b->press_pending && DUE(now, b->press_time + c->chord_window_ms))
+			fire_press(g, i, batch);
+		if (b->press_pending || b->consumed)
+			continue;
+
+		if ((c->long_press_mask & bit) && !b->long_fired
+				&& DUE(now, b->press_time + c->long_press_ms)) {
+			push(batch, GESTURE_LONG_PRESS, bit, 0, now);
+			b->long_fired = 1;
+		}
+
+		if ((c->repeat_mask & bit) && DUE(now, b->repeat_time)) {
+			push(batch, GESTURE_REPEAT, bit, ++b->repeats, now);
+
+			// don't burst to catch up if the caller fell behind
+			b->repeat_time += b->repeat_interval;
+			if (DUE(now, b->repeat_time))
+				b->repeat_time = now + b->repeat_interval;
+
+			// accelerate the next repeat
+			b->repeat_interval -= b->repeat_interval * c->repeat_accel_pct / 100;
+			if (b->repeat_interval < c->repeat_min_interval_ms)
+				b->repeat_interval = c->repeat_min_interval_ms;
+		}
+	}
+}
+
+/*
+ * Work out the earliest time anything needs doing and publish it for gesture_tick().
+ */
+static void rearm(struct gesture_recognizer * g) {
+	const struct gesture_config * c = &g->config;
+	uint32_t next = 0;
+	uint8_t armed = 0;
+	int i;
+
+	for (i = 0; i < GESTURE_BUTTONS; i++) {
+		struct gesture_button * b = &g->buttons[i];
+		uint8_t bit = 1 << i;
+		uint32_t t[3];
+		int n = 0, j;
+
+		if (!(g->mask & bit))
+			continue;
+		if (b->press_pending) {
+			t[n++] = b->press_time + c->chord_window_ms;
+		} else if (!b->consumed) {
+			if ((c->long_press_mask & bit) && !b->long_fired)
+				t[n++] = b->press_time + c->long_press_ms;
+			if (c->repeat_mask & bit)
+				t[n++] = b->repeat_time;
+		}
+		for (j = 0; j < n; j++) {
+			if (!armed || (int32_t)(t[j] - next) < 0)
+				next = t[j];
+			armed = 1;
+		}
+	}
+
+	__atomic_store_n(&g->next_deadline, next, __ATOMIC_RELAXED);
+	__atomic_store_n(&g->armed, armed, __ATOMIC_RELEASE);
+}
+
+void gesture_config_default(struct gesture_config * config) {
+	memset(config, 0, sizeof(*config));
+	config->long_press_ms = 600;
+	config->repeat_delay_ms = 400;
+	config->repeat_interval_ms = 150;
+	config->repeat_min_interval_ms = 30;
+	config->repeat_accel_pct = 15;
+	config->double_click_ms = 300;
+	config->chord_window_ms = 80;
+}
+
+void gesture_init(struct gesture_recognizer * g, const struct gesture_config * config,
+		void (*handler)(const struct gesture_event*, void*), void * user) {
+	int i;
+	memset(g, 0, sizeof(*g));
+	g->config = *config;
+	if (g->config.num_chords > GESTURE_MAX_CHORDS)
+		g->config.num_chords = GESTURE_MAX_CHORDS;
+	for (i = 0; i < g->config.num_chords; i++)
+		g->chord_members |= g->config.chords[i];
+	g->handler = handler;
+	g->user = user;
+	pthread_mutex_init(&g->lock, NULL);
+}
+
+void gesture_update(struct gesture_recognizer * g, uint8_t mask, uint32_t now) {
+	struct gesture_batch batch;
+	uint8_t changed, pressed, released;
+	int i;
+
+	batch.count = 0;
+	mask &= BUTTON_MASK_ALL;
+
+	pthread_mutex_lock(&g->lock);
+
+	changed = mask ^ g->mask;
+	pressed = changed & mask;
+	released = changed & ~mask;
+
+	for (i = 0; i < GESTURE_BUTTONS; i++) {
+		struct gesture_button * b = &g->buttons[i];
+		uint8_t bit = 1 << i;
+
+		if (!(pressed & bit))
+			continue;
+		b->press_time = now;
+		b->long_fired = 0;
+		b->consumed = 0;
+		if (g->chord_members & bit)
+			b->press_pending = 1; // hold the press until the chord window closes
+		else
+			fire_press(g, i, &batch);
+	}
+	g->mask = mask;
+
+	// a chord fires when its last button goes down within the window of the first
+	for (i = 0; i < g->config.num_chords; i++) {
+		uint8_t chord = g->config.chords[i];
+		uint8_t ok = 1;
+		int j;
+
+		if ((mask & chord) != chord || !(pressed & chord))
+			continue;
+		for (j = 0; j < GESTURE_BUTTONS; j++) {
+			struct gesture_button * b = &g->buttons[j];
+			if ((chord & (1 << j))
+					&& (b->consumed || now - b->press_time > g->config.chord_window_ms))
+				ok = 0;
+		}
+		if (!ok)
+			continue;
+
+		push(&batch, GESTURE_CHORD, chord, 0, now);
+		for (j = 0; j < GESTURE_BUTTONS; j++) {
+			if (chord & (1 << j)) {
+				g->buttons[j].consumed = 1;
+				g->buttons[j].press_pending = 0;
+			}
+		}
+	}
+
+	for (i = 0; i < GESTURE_BUTTONS; i++) {
+		struct gesture_button * b = &g->buttons[i];
+		uint8_t bit = 1 << i;
+
+		if (!(released & bit))
+			continue;
+		if (b->press_pending)
+			fire_press(g, i, &batch); // tapped and let go inside the chord window
+		if (!b->consumed)
+			push(&batch, GESTURE_RELEASE, bit, 0, now);
+		b->clicked = (b->clicked == 2 || b->consumed || b->long_fired) ? 0 : 1;
+		b->release_time = now;
+	}
+
+	process_due(g, now, &batch);
+	rearm(g);
+
+	pthread_mutex_unlock(&g->lock);
+
+	deliver(g, &batch);
+}
+
+void gesture_tick(struct gesture_recognizer * g, uint32_t now) {
+	struct gesture_batch batch;
+
+	if (!__atomic_load_n(&g->armed, __ATOMIC_ACQUIRE))
+		return;
+	if (!DUE(now, __atomic_load_n(&g->next_deadline, __ATOMIC_RELAXED)))
+		return;
+
+	batch.count = 0;
+	pthread_mutex_lock(&g->lock);
+	process_due(g, now, &batch);
+	rearm(g);
+	pthread_mutex_unlock(&g->lock);
+
+	deliver(g, &batch);
+}
+
+int gesture_next_timeout_ms(struct gesture_recognizer * g, uint32_t now) {
+	int32_t left = -1;
+
+	pthread_mutex_lock(&g->lock);
+	if (g->armed) {
+		left = (int32_t) (g->next_deadline - now);
+		if (left < 0)
+			left = 0;
+	}
+	pthread_mutex_unlock(&g->lock);
+	return left;
+}
+
+void gesture_destroy(struct gesture_recognizer * g) {
+	pthread_mutex_destroy(&g->lock);
+}
+
+uint32_t gesture_now_ms(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint32_t) (t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
@@ -0,0 +1,195 @@
+/**
+ * @file
+ * @brief Gesture recognition on top of a debounced button bitmask. Turns plain
+ * press/release changes into long-presses, auto-repeat (with acceleration),
+ * double-clicks and multi-button chords.
+ *
+ * The recognizer does not own a thread or a timer. It is fed by the debounce loop
+ * that already exists: gesture_update() is called when the debounced mask changes
+ * and gesture_tick() fires the timed gestures that are due. gesture_next_timeout_ms()
+ * tells the loop how long it may sleep before the next one, so a loop that waits on
+ * edges only needs to wake for a deadline while a button is held, and sleeps without
+ * a timeout otherwise.
+ */
+
+#ifndef GESTURE_H_
+#define GESTURE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+#include "button.h"
+
+/**
+ * Number of buttons tracked by the recognizer (one per bit of BUTTON_MASK_ALL)
+ */
+#define GESTURE_BUTTONS		7
+
+/**
+ * Maximum number of chords that can be configured
+ */
+#define GESTURE_MAX_CHORDS	4
+
+/**
+ * Maximum number of events a single update or tick can produce
+ */
+#define GESTURE_MAX_EVENTS	16
+
+/**
+ * Kinds of events reported to the gesture handler
+ */
+enum gesture_type {
+	GESTURE_PRESS,			// button went down (delayed by the chord window for chord members)
+	GESTURE_RELEASE,		// button went up
+	GESTURE_LONG_PRESS,		// button has been held for long_press_ms
+	GESTURE_REPEAT,			// auto-repeat while the button is held
+	GESTURE_DOUBLE_CLICK,	// second press within double_click_ms of the last release
+	GESTURE_CHORD			// every button of a configured chord went down together
+};
+
+/**
+ * A single recognized gesture.
+ * 		type	What was recognized
+ * 		mask	The button bit (or all chord bits for GESTURE_CHORD)
+ * 		count	Repeat number for GESTURE_REPEAT, 0 otherwise
+ * 		time	Time of the event in milliseconds (see gesture_now_ms())
+ */
+struct gesture_event {
+	enum gesture_type type;
+	uint8_t mask;
+	uint16_t count;
+	uint32_t time;
+};
+
+/**
+ * Timing and feature selection for a recognizer. All times are in milliseconds.
+ * 		long_press_ms			Hold time before GESTURE_LONG_PRESS
+ * 		repeat_delay_ms			Hold time before the first GESTURE_REPEAT
+ * 		repeat_interval_ms		Time between the first repeats
+ * 		repeat_min_interval_ms	Fastest repeat rate the acceleration can reach
+ * 		repeat_accel_pct		Percent the repeat interval shrinks after each repeat
+ * 		double_click_ms			Max time from a release to the next press for a double-click
+ * 		chord_window_ms			Max spread between the presses that make up a chord
+ * 		long_press_mask			Buttons that report GESTURE_LONG_PRESS
+ * 		repeat_mask				Buttons that auto-repeat
+ * 		chords					Button masks that make up each chord
+ * 		num_chords				Number of entries used in chords
+ */
+struct gesture_config {
+	uint32_t long_press_ms;
+	uint32_t repeat_delay_ms;
+	uint32_t repeat_interval_ms;
+	uint32_t repeat_min_interval_ms;
+	uint8_t repeat_accel_pct;
+	uint32_t double_click_ms;
+	uint32_t chord_window_ms;
+	uint8_t long_press_mask;
+	uint8_t repeat_mask;
+	uint8_t chords[GESTURE_MAX_CHORDS];
+	uint8_t num_chords;
+};
+
+/**
+ * Per-button tracking used by the recognizer
+ */
+struct gesture_button {
+	uint32_t press_time;
+	uint32_t release_time;
+	uint32_t repeat_time;
+	uint32_t repeat_interval;
+	uint16_t repeats;
+	uint8_t press_pending;
+	uint8_t long_fired;
+	uint8_t consumed;
+	uint8_t clicked;
+};
+
+/**
+ * State of a gesture recognizer. Treat the members as private; use the functions
+ * below. The lock makes it safe to feed one recognizer from several debounce threads.
+ */
+struct gesture_recognizer {
+	struct gesture_config config;
+	struct gesture_button buttons[GESTURE_BUTTONS];
+	uint8_t mask;
+	uint8_t chord_members;
+	uint8_t armed;
+	uint32_t next_deadline;
+	void (*handler)(const struct gesture_event*, void*);
+	void * user;
+	pthread_mutex_t lock;
+};
+
+/**
+ * Fill a gesture_config with defaults that suit menu navigation: 600 ms long-press,
+ * repeat after 400 ms at 150 ms accelerating by 15% down to 30 ms, 300 ms double-click
+ * and an 80 ms chord window. No buttons repeat or long-press and no chords are set.
+ *
+ * @param gesture_config The configuration to fill in
+ */
+void gesture_config_default(struct gesture_config*);
+
+/**
+ * Initialize a recognizer.
+ *
+ * @param gesture_recognizer The recognizer to initialize
+ * @param gesture_config     The timing and features to use (copied)
+ * @param void(*)            Function called for every recognized gesture
+ * @param void*              User pointer passed to the handler
+ */
+void gesture_init(struct gesture_recognizer*, const struct gesture_config*,
+		void (*)(const struct gesture_event*, void*), void*);
+
+/**
+ * Feed a new debounced button state to the recognizer. Call whenever the debounced
+ * bitmask changes; calling it with an unchanged mask is harmless.
+ *
+ * @param gesture_recognizer The recognizer to update
+ * @param uint8_t            Debounced bitmask of pressed buttons (BUTTON_BIT_*)
+ * @param uint32_t           Current time in milliseconds
+ */
+void gesture_update(struct gesture_recognizer*, uint8_t, uint32_t);
+
+/**
+ * Fire any timed gestures that are due. Call when the time from
+ * gesture_next_timeout_ms() has passed; when nothing is due this is a single
+ * comparison.
+ *
+ * @param gesture_recognizer The recognizer to check
+ * @param uint32_t           Current time in milliseconds
+ */
+void gesture_tick(struct gesture_recognizer*, uint32_t);
+
+/**
+ * Time until the next timed gesture is due, for the debounce loop to sleep on.
+ *
+ * @param gesture_recognizer The recognizer to check
+ * @param uint32_t           Current time in milliseconds
+ *
+ * @return Milliseconds until gesture_tick() has something to do (0 if it is due
+ * 		   already), or -1 when nothing is armed
+ */
+int gesture_next_timeout_ms(struct gesture_recognizer*, uint32_t);
+
+/**
+ * Release any resources held by the recognizer.
+ *
+ * @param gesture_recognizer The recognizer to destroy
+ */
+void gesture_destroy(struct gesture_recognizer*);
+
+/**
+ * Current time in milliseconds from the monotonic clock. Wraps after ~49 days; all
+ * comparisons in the recognizer are wrap-safe.
+ *
+ * @return Milliseconds since an arbitrary fixed point
+ */
+uint32_t gesture_now_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* GESTURE_H_ */
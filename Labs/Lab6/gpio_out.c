@@ -0,0 +1,76 @@
+#include <stddef.h>
+#include "gpio_out.h"
+
+void gpio_out_init(struct gpio_out * port) {
+	port->count = 0;
+	port->shadow = 0;
+	port->known = 0;
+	port->staged = 0;
+	port->staged_mask = 0;
+	port->writes = 0;
+	port->suppressed = 0;
+}
+
+int gpio_out_add(struct gpio_out * port, mraa_gpio_context pin) {
+	if (pin == NULL || port->count == GPIO_OUT_MAX)
+		return -1;
+	if (mraa_gpio_dir(pin, MRAA_GPIO_OUT) != MRAA_SUCCESS)
+		return -1;
+	port->pins[port->count] = pin;
+	return port->count++;
+}
+
+int gpio_out_write_mask(struct gpio_out * port, uint32_t mask, uint32_t values) {
+	// pins that differ from their shadow, plus pins never written
+	uint32_t change = mask & ((port->shadow ^ values) | ~port->known);
+	int written = 0, n;
+
+	for (n = 0; n < port->count; n++) {
+		uint32_t bit = (uint32_t) 1 << n;
+		if ((mask & bit) == 0)
+			continue;
+		if ((change & bit) == 0) {
+			port->suppressed++;
+			continue;
+		}
+		if (mraa_gpio_write(port->pins[n], (values & bit) != 0) != MRAA_SUCCESS)
+			return -1; // shadow left alone: the pin's value is unknown
+		port->shadow = (port->shadow & ~bit) | (values & bit);
+		port->known |= bit;
+		port->writes++;
+		written++;
+	}
+	return written;
+}
+
+int gpio_out_write(struct gpio_out * port, int pin, int value) {
+	if (pin < 0 || pin >= port->count)
+		return -1;
+	return gpio_out_write_mask(port, (uint32_t) 1 << pin, value ? (uint32_t) 1 << pin : 0);
+}
+
+void gpio_out_stage(struct gpio_out * port, int pin, int value) {
+	uint32_t bit;
+
+	if (pin < 0 || pin >= port->count)
+		return;
+	bit = (uint32_t) 1 << pin;
+	port->staged = value ? port->staged | bit : port->staged & ~bit;
+	port->staged_mask |= bit;
+}
+
+int gpio_out_commit(struct gpio_out * port) {
+	uint32_t mask = port->staged_mask, values = port->staged;
+
+	port->staged_mask = 0;
+	port->staged = 0;
+	return gpio_out_write_mask(port, mask, values);
+}
+
+void gpio_out_close(struct gpio_out * port) {
+	int n;
+
+	for (n = 0; n < port->count; n++)
+		mraa_gpio_close(port->pins[n]);
+	port->count = 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file
+ * @brief Output pins grouped into a port that remembers (shadows) the value last
+ * written to each pin. A write only reaches the hardware when it changes a pin, so
+ * loops that set their outputs on every pass cost a sysfs write only when something
+ * actually changes. Several pins can be staged and then committed together, and the
+ * writes issued and suppressed are counted.
+ *
+ * e.g.: struct gpio_out leds;
+ * 		 int red, yellow;
+ * 		 gpio_out_init(&leds);
+ * 		 red = gpio_out_add(&leds, mraa_gpio_init(7));
+ * 		 yellow = gpio_out_add(&leds, mraa_gpio_init(8));
+ * 		 gpio_out_stage(&leds, red, 1);
+ * 		 gpio_out_stage(&leds, yellow, 0);
+ * 		 gpio_out_commit(&leds);
+ */
+
+#ifndef GPIO_OUT_H_
+#define GPIO_OUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <mraa.h>
+
+/**
+ * Most pins in one port (one per bit of the shadow)
+ */
+#define GPIO_OUT_MAX	32
+
+/**
+ * A port of output pins. Pin n of the port is bit n of each mask.
+ * 		count		Number of pins in the port
+ * 		pins		MRAA context of each pin
+ * 		shadow		Value last written to each pin
+ * 		known		Pins written at least once, so their shadow matches the hardware
+ * 		staged		Values waiting for gpio_out_commit()
+ * 		staged_mask	Pins with a staged value
+ * 		writes		Hardware writes issued
+ * 		suppressed	Writes skipped because the pin already had the value
+ */
+struct gpio_out {
+	int count;
+	mraa_gpio_context pins[GPIO_OUT_MAX];
+	uint32_t shadow;
+	uint32_t known;
+	uint32_t staged;
+	uint32_t staged_mask;
+	unsigned long writes;
+	unsigned long suppressed;
+};
+
+/**
+ * Start an empty port.
+ *
+ * @param gpio_out The port to initialize
+ */
+void gpio_out_init(struct gpio_out*);
+
+/**
+ * Add a pin to the port and set it as an output. The pin's first write always
+ * reaches the hardware.
+ *
+ * @param gpio_out          The port to add to
+ * @param mraa_gpio_context The initialized pin
+ *
+ * @return Number of the pin within the port, or -1 if the pin is NULL, the port is
+ * full or the pin can't be set as an output
+ */
+int gpio_out_add(struct gpio_out*, mraa_gpio_context);
+
+/**
+ * Set one pin now. Nothing is written if the pin already has the value.
+ *
+ * @param gpio_out The port holding the pin
+ * @param int      Number of the pin within the port
+ * @param int      Value to write (0 or 1)
+ *
+ * @return 1 if the hardware was written, 0 if the write was suppressed, -1 on failure
+ */
+int gpio_out_write(struct gpio_out*, int, int);
+
+/**
+ * Set the pins selected by a mask to the matching bits of a value, writing only the
+ * pins that change.
+ *
+ * @param gpio_out The port to write
+ * @param uint32_t Pins to set
+ * @param uint32_t Their new values
+ *
+ * @return Number of pins written, or -1 if a write failed
+ */
+int gpio_out_write_mask(struct gpio_out*, uint32_t, uint32_t);
+
+/**
+ * Stage a value for one pin without writing it. A later stage of the same pin
+ * replaces the earlier one.
+ *
+ * @param gpio_out The port holding the pin
+ * @param int      Number of the pin within the port
+ * @param int      Value to stage (0 or 1)
+ */
+void gpio_out_stage(struct gpio_out*, int, int);
+
+/**
+ * Write every staged pin whose value differs from its shadow and clear the stage.
+ *
+ * @param gpio_out The port to commit
+ *
+ * @return Number of pins written, or -1 if a write failed
+ */
+int gpio_out_commit(struct gpio_out*);
+
+/**
+ * Close every pin in the port.
+ *
+ * @param gpio_out The port to close
+ */
+void gpio_out_close(struct gpio_out*);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* GPIO_OUT_H_ */